@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "arena.h"
+
+#define ARENA_ALIGN 16
+#define ARENA_THREAD_BLOCK (64 * 1024)          /** block size of the arenas kept by threads */
+#define ARENA_THREAD_KEEP (16 * 1024 * 1024)    /** larger arenas are not kept once released */
+
+/** a block of memory, the allocations follow the header */
+typedef struct arena_block_s {
+    struct arena_block_s* next;
+    size_t size;        /** bytes after the header */
+    size_t used;
+} arena_block_t;
+
+#define ARENA_HEADER ((sizeof(arena_block_t) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+struct arena_s {
+    size_t block_size;
+    size_t n_byte;          /** size of all the blocks */
+    arena_block_t* head;
+    arena_block_t* cur;     /** block allocations come from, those after it are free */
+};
+
+static arena_block_t* arena_block_init(size_t size)
+{
+    arena_block_t* b = (arena_block_t*) malloc(ARENA_HEADER + size);
+    if (!b)
+        return NULL;
+    b->next = NULL;
+    b->size = size;
+    b->used = 0;
+    return b;
+}
+
+arena_t* arena_init(size_t block_size)
+{
+    arena_t* a = (arena_t*) calloc(1, sizeof(arena_t));
+    a->block_size = block_size ? block_size : 4096;
+    return a;
+}
+
+void arena_free(arena_t* a)
+{
+    arena_block_t* b;
+    if (!a)
+        return;
+    while (a->head) {
+        b = a->head;
+        a->head = b->next;
+        free(b);
+    }
+    free(a);
+}
+
+void arena_reset(arena_t* a)
+{
+    arena_block_t* b;
+    for (b = a->head; b; b = b->next) {
+        b->used = 0;
+    }
+    a->cur = a->head;
+}
+
+void* arena_alloc(arena_t* a, size_t size)
+{
+    arena_block_t* b;
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    if (!a->cur || a->cur->used + size > a->cur->size) {
+        /** the next kept block if it is large enough, else a new one inserted before it */
+        if (a->cur && a->cur->next && a->cur->next->size >= size) {
+            b = a->cur->next;
+        } else {
+            if ( (b = arena_block_init(size > a->block_size ? size : a->block_size)) == NULL) {
+                perror("arena_alloc: out of memory");
+                return NULL;
+            }
+            a->n_byte += b->size;
+            if (a->cur) {
+                b->next = a->cur->next;
+                a->cur->next = b;
+            } else {
+                b->next = a->head;
+                a->head = b;
+            }
+        }
+        a->cur = b;
+    }
+    b = a->cur;
+    b->used += size;
+    return (char*) b + ARENA_HEADER + b->used - size;
+}
+
+void* arena_calloc(arena_t* a, size_t n, size_t size)
+{
+    void* p = arena_alloc(a, n * size);
+    if (p)
+        memset(p, 0, n * size);
+    return p;
+}
+
+/** the arena each thread keeps, NULL while it is acquired */
+static pthread_key_t arena_key;
+static pthread_once_t arena_key_once = PTHREAD_ONCE_INIT;
+
+static void arena_thread_destroy(void* a)
+{
+    arena_free((arena_t*) a);
+}
+
+static void arena_key_init(void)
+{
+    pthread_key_create(&arena_key, arena_thread_destroy);
+}
+
+arena_t* arena_thread_acquire(void)
+{
+    arena_t* a;
+    pthread_once(&arena_key_once, arena_key_init);
+    if ( (a = (arena_t*) pthread_getspecific(arena_key)) == NULL)
+        return arena_init(ARENA_THREAD_BLOCK);
+    pthread_setspecific(arena_key, NULL);
+    return a;
+}
+
+void arena_thread_release(arena_t* a)
+{
+    if (!a)
+        return;
+    /** a nested acquire got a second arena, only one is kept */
+    if (a->n_byte > ARENA_THREAD_KEEP || pthread_getspecific(arena_key) != NULL) {
+        arena_free(a);
+        return;
+    }
+    arena_reset(a);
+    pthread_setspecific(arena_key, a);
+}
@@ -0,0 +1,62 @@
+/*************************************************************************************************
+ * arena.h
+ * Region allocator for structures that live and die together, like the node and edge sets of
+ * one sausage. Allocations are carved out of large blocks and are never freed one by one: the
+ * whole arena is reset or freed in one call. Each thread also keeps an arena for short-lived
+ * work like answering a query, so that it rarely goes back to malloc().
+ *
+ *************************************************************************************************/
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stddef.h>
+
+/**
+ * arena_t
+ */
+typedef struct arena_s arena_t;
+
+/**
+ * function: arena_init()
+ * Create an empty arena that takes memory from the system **block_size** bytes at a time
+ */
+arena_t* arena_init(size_t block_size);
+
+/**
+ * function: arena_free()
+ * Free the arena and everything allocated from it
+ */
+void arena_free(arena_t* a);
+
+/**
+ * function: arena_reset()
+ * Drop everything allocated from the arena, keeping its blocks for the next allocations
+ */
+void arena_reset(arena_t* a);
+
+/**
+ * function: arena_alloc()
+ * Return **size** bytes aligned for any type, valid until the arena is reset or freed
+ */
+void* arena_alloc(arena_t* a, size_t size);
+
+/**
+ * function: arena_calloc()
+ * Same as arena_alloc() for **n** zeroed elements of **size** bytes
+ */
+void* arena_calloc(arena_t* a, size_t n, size_t size);
+
+/**
+ * function: arena_thread_acquire()
+ * Return an empty arena for the calling thread: the one the thread keeps if it is not in use,
+ * else a new one. To be handed back with arena_thread_release() by the same thread.
+ */
+arena_t* arena_thread_acquire(void);
+
+/**
+ * function: arena_thread_release()
+ * Drop everything allocated from **a** and keep it for the next arena_thread_acquire()
+ */
+void arena_thread_release(arena_t* a);
+
+#endif
@@ -0,0 +1,400 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "artifact.h"
+#include "arena.h"
+
+#define ARTIFACT_MAGIC "SDRART"
+#define ARTIFACT_VERSION 1
+#define WORD_MAX_LENGTH 15
+
+/** archive header, followed by **n_word** NUL-padded names of WORD_MAX_LENGTH + 1 bytes */
+typedef struct artifact_header_s {
+    char magic[8];
+    int32 version;
+    int32 n_word;
+    float64 logbase;
+} artifact_header_t;
+
+/**
+ * Header of the record of an utterance. It is followed by the uttid, NUL-padded to a multiple
+ * of 4 bytes, the links, then the n_slot + 1 offsets (none without sausage), wids and posteriors
+ * of the sausage.
+ */
+typedef struct artifact_rec_s {
+    int32 size;         /** bytes of the record after this header */
+    int32 uttid_size;
+    int32 frate;
+    int32 norm;
+    int32 n_link;
+    int32 n_slot;
+    int32 n_edge;
+} artifact_rec_t;
+
+struct artifact_writer_s {
+    FILE* fp;
+    vocab_t* vocab;
+    pthread_mutex_t lock;   /** a record is written at once */
+    int error;
+};
+
+struct artifact_s {
+    void* map;
+    size_t size;
+    size_t first;       /** offset of the first record */
+    size_t pos;         /** offset of the next record */
+    int32 n_word;
+    vocab_t* vocab;
+    logmath_t* lmath;   /** to log-add the scores of the links again */
+};
+
+static size_t artifact_rec_size(const artifact_rec_t* rec)
+{
+    return (size_t) rec->uttid_size + (size_t) rec->n_link * sizeof(lat_link_t)
+        + ((rec->n_slot > 0) ? (size_t) (rec->n_slot + 1) : 0) * sizeof(int32)
+        + (size_t) 2 * rec->n_edge * sizeof(int32);
+}
+
+artifact_writer_t* artifact_writer_init(const char* filename, vocab_t* vocab, float64 logbase)
+{
+    artifact_writer_t* w;
+    artifact_header_t header;
+    char word[WORD_MAX_LENGTH + 1];
+    int i;
+
+    if (!vocab) {
+        perror("artifact_writer_init: no vocabulary");
+        return NULL;
+    }
+    w = (artifact_writer_t*) calloc(1, sizeof(artifact_writer_t));
+    if ( (w->fp = fopen(filename, "wb")) == NULL) {
+        perror("Failed to open file to write artifacts");
+        free(w);
+        return NULL;
+    }
+    w->vocab = vocab_retain(vocab);
+    pthread_mutex_init(&(w->lock), NULL);
+
+    memset(&header, 0, sizeof(header));
+    strncpy(header.magic, ARTIFACT_MAGIC, sizeof(header.magic));
+    header.version = ARTIFACT_VERSION;
+    header.n_word = vocab_size(vocab);
+    header.logbase = logbase;
+    if (fwrite(&header, sizeof(header), 1, w->fp) != 1)
+        w->error = 1;
+    for (i = 0; i < header.n_word; i++) {
+        memset(word, 0, sizeof(word));
+        strncpy(word, vocab_word(vocab, i), WORD_MAX_LENGTH);
+        if (fwrite(word, sizeof(word), 1, w->fp) != 1)
+            w->error = 1;
+    }
+    if (w->error) {
+        perror("Failed to write artifact header");
+        artifact_writer_free(w);
+        return NULL;
+    }
+    return w;
+}
+
+vocab_t* artifact_writer_get_vocab(artifact_writer_t* w)
+{
+    return w->vocab;
+}
+
+int artifact_write(artifact_writer_t* w, const char* uttid, int32 frate, int32 norm,
+                   const lat_link_t* links, int n_link, lite_sausage_t* lite_s)
+{
+    artifact_rec_t rec;
+    arena_t* scratch;
+    char* id;
+    int32 *off = NULL, *wid = NULL, *post = NULL;
+    const int32 *s_wid, *s_post;
+    int i, k, n, rv = 0;
+    vocab_t* s_vocab;
+
+    memset(&rec, 0, sizeof(rec));
+    rec.uttid_size = (strlen(uttid) + 1 + 3) & ~3;
+    rec.frate = frate;
+    rec.norm = norm;
+    rec.n_link = n_link;
+
+    /** the sausage is stored in the words of the archive, translated if it uses others */
+    scratch = arena_thread_acquire();
+    id = (char*) arena_calloc(scratch, rec.uttid_size, 1);
+    strcpy(id, uttid);
+    if (lite_s) {
+        s_vocab = lite_sausage_get_vocab(lite_s);
+        rec.n_slot = lite_sausage_n_slot(lite_s);
+        off = (int32*) arena_alloc(scratch, (rec.n_slot + 1) * sizeof(int32));
+        for (i = 0; i < rec.n_slot; i++) {
+            rec.n_edge += lite_sausage_slot(lite_s, i, &s_wid, &s_post);
+        }
+        wid = (int32*) arena_alloc(scratch, (rec.n_edge + 1) * sizeof(int32));
+        post = (int32*) arena_alloc(scratch, (rec.n_edge + 1) * sizeof(int32));
+        rec.n_edge = 0;
+        for (i = 0; i < rec.n_slot; i++) {
+            off[i] = rec.n_edge;
+            n = lite_sausage_slot(lite_s, i, &s_wid, &s_post);
+            for (k = 0; k < n; k++) {
+                wid[rec.n_edge] = (s_vocab == w->vocab)
+                    ? s_wid[k] : vocab_wid(w->vocab, vocab_word(s_vocab, s_wid[k]));
+                if (wid[rec.n_edge] < 0)
+                    continue;
+                post[rec.n_edge++] = s_post[k];
+            }
+        }
+        off[rec.n_slot] = rec.n_edge;
+    }
+    rec.size = artifact_rec_size(&rec);
+
+    pthread_mutex_lock(&(w->lock));
+    if (fwrite(&rec, sizeof(rec), 1, w->fp) != 1
+        || fwrite(id, rec.uttid_size, 1, w->fp) != 1
+        || (n_link > 0 && fwrite(links, sizeof(lat_link_t), n_link, w->fp) != (size_t) n_link)
+        || (rec.n_slot > 0 && fwrite(off, sizeof(int32), rec.n_slot + 1, w->fp) != (size_t) rec.n_slot + 1)
+        || (rec.n_edge > 0 && fwrite(wid, sizeof(int32), rec.n_edge, w->fp) != (size_t) rec.n_edge)
+        || (rec.n_edge > 0 && fwrite(post, sizeof(int32), rec.n_edge, w->fp) != (size_t) rec.n_edge)) {
+        perror("Failed to write artifact");
+        w->error = 1;
+        rv = -1;
+    }
+    pthread_mutex_unlock(&(w->lock));
+    arena_thread_release(scratch);
+    return rv;
+}
+
+int artifact_writer_free(artifact_writer_t* w)
+{
+    int rv;
+    if (!w)
+        return 0;
+    rv = (fclose(w->fp) != 0 || w->error) ? -1 : 0;
+    vocab_free(w->vocab);
+    pthread_mutex_destroy(&(w->lock));
+    free(w);
+    return rv;
+}
+
+artifact_t* artifact_open(const char* filename)
+{
+    int fd;
+    int i;
+    struct stat st;
+    void* map;
+    const artifact_header_t* header;
+    const char** words;
+    artifact_t* a;
+
+    if ( (fd = open(filename, O_RDONLY)) < 0) {
+        perror("Failed to open file.");
+        return NULL;
+    }
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(artifact_header_t)) {
+        perror("Not an artifact archive");
+        close(fd);
+        return NULL;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("Failed to map artifact archive");
+        return NULL;
+    }
+    header = (const artifact_header_t*) map;
+    if (strncmp(header->magic, ARTIFACT_MAGIC, sizeof(header->magic)) != 0
+        || header->version != ARTIFACT_VERSION
+        || header->n_word <= 0 || header->logbase <= 1.0
+        || sizeof(artifact_header_t) + (size_t) header->n_word * (WORD_MAX_LENGTH + 1) > (size_t) st.st_size) {
+        fprintf(stderr, "%s: bad artifact header or version\n", filename);
+        munmap(map, st.st_size);
+        return NULL;
+    }
+
+    a = (artifact_t*) calloc(1, sizeof(artifact_t));
+    a->map = map;
+    a->size = st.st_size;
+    a->n_word = header->n_word;
+    a->first = a->pos = sizeof(artifact_header_t) + (size_t) header->n_word * (WORD_MAX_LENGTH + 1);
+    /** the names are NUL-padded, the last byte of each is always NUL */
+    words = (const char**) malloc(header->n_word * sizeof(char*));
+    for (i = 0; i < header->n_word; i++) {
+        words[i] = (const char*) map + sizeof(artifact_header_t) + (size_t) i * (WORD_MAX_LENGTH + 1);
+    }
+    a->vocab = vocab_init(words, header->n_word);
+    free(words);
+    a->lmath = logmath_init(header->logbase, 0, TRUE);
+    return a;
+}
+
+void artifact_close(artifact_t* a)
+{
+    if (!a)
+        return;
+    vocab_free(a->vocab);
+    logmath_free(a->lmath);
+    munmap(a->map, a->size);
+    free(a);
+}
+
+vocab_t* artifact_get_vocab(artifact_t* a)
+{
+    return a->vocab;
+}
+
+void artifact_rewind(artifact_t* a)
+{
+    a->pos = a->first;
+}
+
+int artifact_next(artifact_t* a, artifact_utt_t* utt)
+{
+    const artifact_rec_t* rec;
+    const char* p;
+    int i;
+
+    if (a->pos == a->size)
+        return 0;
+    rec = (const artifact_rec_t*) ((const char*) a->map + a->pos);
+    if (a->pos + sizeof(artifact_rec_t) > a->size
+        || rec->uttid_size <= 0 || rec->uttid_size % sizeof(int32) != 0
+        || rec->n_link < 0 || rec->n_slot < 0 || rec->n_edge < 0
+        || rec->size < 0 || (size_t) rec->size != artifact_rec_size(rec)
+        || a->pos + sizeof(artifact_rec_t) + rec->size > a->size) {
+        fprintf(stderr, "artifact_next: damaged record at %ld\n", (long) a->pos);
+        return -1;
+    }
+    p = (const char*) (rec + 1);
+    utt->uttid = p;
+    utt->frate = rec->frate;
+    utt->norm = rec->norm;
+    utt->n_link = rec->n_link;
+    utt->n_slot = rec->n_slot;
+    p += rec->uttid_size;
+    utt->links = (const lat_link_t*) p;
+    p += (size_t) rec->n_link * sizeof(lat_link_t);
+    utt->off = (const int32*) p;
+    p += (rec->n_slot > 0) ? (size_t) (rec->n_slot + 1) * sizeof(int32) : 0;
+    utt->wid = (const int32*) p;
+    utt->post = utt->wid + rec->n_edge;
+
+    /** the wids index arrays of the vocabulary, check them before anyone does */
+    if (utt->uttid[rec->uttid_size - 1] != '\0'
+        || (rec->n_slot > 0 && (utt->off[0] != 0 || utt->off[rec->n_slot] != rec->n_edge))
+        || (rec->n_slot == 0 && rec->n_edge != 0)) {
+        fprintf(stderr, "artifact_next: damaged record at %ld\n", (long) a->pos);
+        return -1;
+    }
+    for (i = 0; i < rec->n_link; i++) {
+        if (utt->links[i].wid < 0 || utt->links[i].wid >= a->n_word
+            || utt->links[i].next_wid < -1 || utt->links[i].next_wid >= a->n_word) {
+            fprintf(stderr, "%s: link %d is out of range\n", utt->uttid, i);
+            return -1;
+        }
+    }
+    for (i = 0; i < rec->n_slot; i++) {
+        if (utt->off[i+1] < utt->off[i]) {
+            fprintf(stderr, "%s: slot %d is out of range\n", utt->uttid, i);
+            return -1;
+        }
+    }
+    for (i = 0; i < rec->n_edge; i++) {
+        if (utt->wid[i] < 0 || utt->wid[i] >= a->n_word) {
+            fprintf(stderr, "%s: sausage word %d is out of range\n", utt->uttid, i);
+            return -1;
+        }
+    }
+    a->pos += sizeof(artifact_rec_t) + rec->size;
+    return 1;
+}
+
+/** wid in **vocab** of every word of the archive, -1 if it has none; NULL if they are the same */
+static int32* artifact_wid_map(artifact_t* a, vocab_t* vocab)
+{
+    int32* map;
+    int i, same;
+
+    if (!vocab || vocab == a->vocab)
+        return NULL;
+    map = (int32*) malloc(a->n_word * sizeof(int32));
+    same = (vocab_size(vocab) == a->n_word);
+    for (i = 0; i < a->n_word; i++) {
+        map[i] = vocab_wid(vocab, vocab_word(a->vocab, i));
+        if (map[i] != i)
+            same = 0;
+    }
+    if (same) {
+        free(map);
+        return NULL;
+    }
+    return map;
+}
+
+int artifact_reindex(artifact_t* a, inverted_index_t* index, dualclue_index_t* dc_index, float32 ascale)
+{
+    int32 *map, *dc_map;
+    artifact_utt_t utt;
+    arena_t* scratch;
+    lat_link_t* links;
+    int32 *off, *wid, *post;
+    lite_sausage_t* lite_s;
+    int i, k, n_link, n_edge, n_utt = 0, rv;
+
+    if (!index && !dc_index) {
+        perror("artifact_reindex: no index");
+        return -1;
+    }
+    map = index ? artifact_wid_map(a, inverted_index_get_vocab(index)) : NULL;
+    dc_map = dc_index ? artifact_wid_map(a, dualclue_index_get_vocab(dc_index)) : NULL;
+
+    artifact_rewind(a);
+    while ( (rv = artifact_next(a, &utt)) > 0) {
+        scratch = arena_thread_acquire();
+        if (index) {
+            links = (lat_link_t*) utt.links;
+            n_link = utt.n_link;
+            if (map) {
+                links = (lat_link_t*) arena_alloc(scratch, (utt.n_link + 1) * sizeof(lat_link_t));
+                for (i = n_link = 0; i < utt.n_link; i++) {
+                    if (map[utt.links[i].wid] < 0)
+                        continue;
+                    links[n_link] = utt.links[i];
+                    links[n_link].wid = map[utt.links[i].wid];
+                    links[n_link].next_wid = (utt.links[i].next_wid < 0) ? -1 : map[utt.links[i].next_wid];
+                    n_link++;
+                }
+            }
+            inverted_index_add_links(index, utt.uttid, links, n_link, utt.norm, utt.frate, a->lmath, ascale);
+        }
+        if (dc_index && utt.n_slot > 0) {
+            off = (int32*) utt.off;
+            wid = (int32*) utt.wid;
+            post = (int32*) utt.post;
+            if (dc_map) {
+                off = (int32*) arena_alloc(scratch, (utt.n_slot + 1) * sizeof(int32));
+                wid = (int32*) arena_alloc(scratch, (utt.off[utt.n_slot] + 1) * sizeof(int32));
+                post = (int32*) arena_alloc(scratch, (utt.off[utt.n_slot] + 1) * sizeof(int32));
+                for (i = n_edge = 0; i < utt.n_slot; i++) {
+                    off[i] = n_edge;
+                    for (k = utt.off[i]; k < utt.off[i+1]; k++) {
+                        if ( (wid[n_edge] = dc_map[utt.wid[k]]) >= 0)
+                            post[n_edge++] = utt.post[k];
+                    }
+                }
+                off[utt.n_slot] = n_edge;
+            }
+            lite_s = lite_sausage_init(dualclue_index_get_vocab(dc_index), utt.n_slot, off, wid, post);
+            dualclue_index_addhit(dc_index, utt.uttid, lite_s);
+            lite_sausage_free(lite_s);
+        }
+        arena_thread_release(scratch);
+        n_utt++;
+    }
+    free(map);
+    free(dc_map);
+    return (rv < 0) ? -1 : n_utt;
+}
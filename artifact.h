@@ -0,0 +1,113 @@
+/*************************************************************************************************
+ * artifact.h
+ * An archive of what recognition produced for each utterance: the links of its lattice, as
+ * the lattice index takes them before any pruning, and its simplified sausage. Indexes can be
+ * rebuilt from an archive, with other pruning settings, without decoding the audio again.
+ *
+ * The archive starts with its word list and the log base of the scores, then the utterances
+ * follow as self-sized records, so it can be mapped or read as a stream.
+ *
+ *************************************************************************************************/
+#ifndef __ARTIFACT_H__
+#define __ARTIFACT_H__
+
+#include "pocketsphinx.h"
+#include "index.h"
+#include "sausage.h"
+
+/**
+ * artifact_writer_t
+ */
+typedef struct artifact_writer_s artifact_writer_t;
+
+/**
+ * artifact_t
+ * A mapped archive, read one utterance after the other
+ */
+typedef struct artifact_s artifact_t;
+
+/**
+ * artifact_utt_t
+ * An utterance of a mapped archive, the arrays point into the map
+ */
+typedef struct artifact_utt_s {
+    const char* uttid;
+    int32 frate;
+    int32 norm;                 /** normalizer of the lattice scores */
+    int n_link;
+    const lat_link_t* links;
+    int n_slot;                 /** 0 if no sausage was stored */
+    const int32* off;           /** n_slot + 1 offsets into **wid** and **post**, see lite_sausage_init() */
+    const int32* wid;
+    const int32* post;
+} artifact_utt_t;
+
+/**
+ * function: artifact_writer_init()
+ * Create the archive **filename** over **vocab**, for scores in base **logbase** (the -logbase
+ * of the decoder). Returns NULL on error.
+ */
+artifact_writer_t* artifact_writer_init(const char* filename, vocab_t* vocab, float64 logbase);
+
+/**
+ * function: artifact_writer_get_vocab()
+ * the vocabulary the wids of the links must refer to
+ */
+vocab_t* artifact_writer_get_vocab(artifact_writer_t* w);
+
+/**
+ * function: artifact_write()
+ * Append an utterance: **links** taken by lattice_get_links() with the vocabulary of the
+ * writer, the normalizer **norm** and frame rate **frate** of the lattice, and **lite_s**, which
+ * may be NULL. Threads may write at once. Returns 0, -1 on error.
+ */
+int artifact_write(artifact_writer_t* w, const char* uttid, int32 frate, int32 norm,
+                   const lat_link_t* links, int n_link, lite_sausage_t* lite_s);
+
+/**
+ * function: artifact_writer_free()
+ * Close the archive. Returns 0, -1 if anything failed to be written.
+ */
+int artifact_writer_free(artifact_writer_t* w);
+
+/**
+ * function: artifact_open()
+ * Map the archive **filename**. Returns NULL on error.
+ */
+artifact_t* artifact_open(const char* filename);
+
+/**
+ * function: artifact_close()
+ * Unmap the archive
+ */
+void artifact_close(artifact_t* a);
+
+/**
+ * function: artifact_get_vocab()
+ * the vocabulary of the archive, rebuilt from its word list
+ */
+vocab_t* artifact_get_vocab(artifact_t* a);
+
+/**
+ * function: artifact_next()
+ * Point **utt** to the next utterance. Returns 1, 0 at the end of the archive, -1 if the
+ * record is damaged.
+ */
+int artifact_next(artifact_t* a, artifact_utt_t* utt);
+
+/**
+ * function: artifact_rewind()
+ * Go back to the first utterance
+ */
+void artifact_rewind(artifact_t* a);
+
+/**
+ * function: artifact_reindex()
+ * Add every utterance of the archive to **index** and **dc_index**, either may be NULL, under
+ * their current settings (see inverted_index_set_pruning()); **ascale** scales the acoustic
+ * scores as in inverted_index_addhits(). Words are matched by name if the indexes have another
+ * word list. Returns the number of utterances, -1 on error.
+ */
+int artifact_reindex(artifact_t* a, inverted_index_t* index, dualclue_index_t* dc_index, float32 ascale);
+
+#endif
@@ -0,0 +1,83 @@
+#include <stdlib.h>
+#include <string.h>
+#include "bufio.h"
+
+struct bufio_s {
+    FILE* fp;
+    size_t rec_size;
+    size_t n_buf;
+    char* buf;
+    off_t off;          /** file offset of the next buffer to read, or to write */
+    uint32 n_left;      /** records of the range not read into the buffer yet */
+    size_t n;           /** records in the buffer */
+    size_t i;           /** next record to hand out */
+    int error;
+};
+
+bufio_t* bufio_init(FILE* fp, size_t rec_size, size_t n_buf)
+{
+    bufio_t* b = (bufio_t*) calloc(1, sizeof(bufio_t));
+    b->fp = fp;
+    b->rec_size = rec_size;
+    b->n_buf = n_buf ? n_buf : 1;
+    b->buf = (char*) malloc(b->n_buf * rec_size);
+    return b;
+}
+
+void bufio_free(bufio_t* b)
+{
+    if (!b)
+        return;
+    free(b->buf);
+    free(b);
+}
+
+void bufio_seek(bufio_t* b, off_t off, uint32 n_rec)
+{
+    b->off = off;
+    b->n_left = n_rec;
+    b->n = b->i = 0;
+}
+
+const void* bufio_read(bufio_t* b)
+{
+    size_t n;
+    if (b->i == b->n) {
+        if (b->n_left == 0 || b->error)
+            return NULL;
+        n = (b->n_left < b->n_buf) ? b->n_left : b->n_buf;
+        if (fseeko(b->fp, b->off, SEEK_SET) != 0 || fread(b->buf, b->rec_size, n, b->fp) != n) {
+            b->error = 1;
+            return NULL;
+        }
+        b->off += n * b->rec_size;
+        b->n_left -= n;
+        b->n = n;
+        b->i = 0;
+    }
+    return b->buf + b->rec_size * b->i++;
+}
+
+int bufio_write(bufio_t* b, const void* rec)
+{
+    if (b->n == b->n_buf && bufio_flush(b) < 0)
+        return -1;
+    memcpy(b->buf + b->rec_size * b->n++, rec, b->rec_size);
+    return 0;
+}
+
+int bufio_flush(bufio_t* b)
+{
+    if (b->n == 0)
+        return b->error ? -1 : 0;
+    if (fseeko(b->fp, b->off, SEEK_SET) != 0 || fwrite(b->buf, b->rec_size, b->n, b->fp) != b->n) 
+        b->error = 1;
+    b->off += b->n * b->rec_size;
+    b->n = 0;
+    return b->error ? -1 : 0;
+}
+
+int bufio_error(bufio_t* b)
+{
+    return b->error;
+}
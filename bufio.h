@@ -0,0 +1,63 @@
+/*************************************************************************************************
+ * bufio.h
+ * Fixed-size buffers over sections of binary index files, so that posting lists can be streamed
+ * through a bounded amount of memory. A reader walks a range of records of one size, a writer
+ * fills a range of the output; several of them may share one FILE, each seeks before it reads
+ * or writes a buffer.
+ *
+ *************************************************************************************************/
+#ifndef __BUFIO_H__
+#define __BUFIO_H__
+
+#include <stdio.h>
+#include <sys/types.h>
+#include "pocketsphinx.h"
+
+/**
+ * bufio_t
+ */
+typedef struct bufio_s bufio_t;
+
+/**
+ * function: bufio_init()
+ * Create a buffer of **n_buf** records of **rec_size** bytes over **fp**
+ */
+bufio_t* bufio_init(FILE* fp, size_t rec_size, size_t n_buf);
+
+/**
+ * function: bufio_free()
+ * Free the buffer, without flushing it
+ */
+void bufio_free(bufio_t* b);
+
+/**
+ * function: bufio_seek()
+ * Start reading **n_rec** records, or writing records, at byte offset **off**
+ */
+void bufio_seek(bufio_t* b, off_t off, uint32 n_rec);
+
+/**
+ * function: bufio_read()
+ * Return the next record of the range, NULL at its end or on a read error
+ */
+const void* bufio_read(bufio_t* b);
+
+/**
+ * function: bufio_write()
+ * Append a record, writing the buffer out when it is full. Returns 0, -1 on error.
+ */
+int bufio_write(bufio_t* b, const void* rec);
+
+/**
+ * function: bufio_flush()
+ * Write out the buffered records. Returns 0, -1 on error.
+ */
+int bufio_flush(bufio_t* b);
+
+/**
+ * function: bufio_error()
+ * Nonzero if a read or write failed since the buffer was created
+ */
+int bufio_error(bufio_t* b);
+
+#endif
@@ -1,27 +1,43 @@
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
 #include "index.h"
+#include "bufio.h"
+#include "arena.h"
 
 #define SENSCR_SHIFT 10
 
 #define WORD_MAX_LENGTH 15
 #define MAX_LINE_LENGTH 256
 #define INTERVAL 0.3 /*  */
+#define DEFAULT_FRATE 100
+#define POSTINGS_INIT_SIZE 16
+#define N_STRIPE 64     /** locks guarding the posting lists while stages are published */
+
+/** binary index: magic, format version and the header flag set when every posting list is sorted */
+#define INDEX_BIN_MAGIC "SDRLIDX"
+#define INDEX_BIN_VERSION 4
+#define INDEX_BIN_SORTED 0x1
 /** 
  * hit_t
+ * One posting unpacked from the columns of its word, words are looked up in the vocabulary.
  */
 struct hit_s {
-    char *uttid;   /** uttarence id */
+    int32 utt;   /** uttarence ordinal in the index's uttdict */
     int32 norm;  /** utterance normalizer */
    
-    int wid;
-    char* word;
-    char* subseq_word;
+    int32 wid;
+    int32 next_wid;     /** wid of the successor word, -1 if not in the vocabulary */
     
-    int from_id, to_id;
+    int32 from_id, to_id;
     
-    double start_time;   /** start time in seconds */ 
-    double end_time;    /** end time in seconds */
+    int32 sf;     /** start frame */ 
+    int32 ef;     /** end frame */
     int32 alpha;  /** forward likelihood */
     int32 beta;   /** backward likelihood */
     int32 ascr;   /** acoustic model score */
@@ -29,26 +45,135 @@ struct hit_s {
     struct hit_s *next;   /** pointer to next hit */
 };
 
+/**
+ * Columns of a posting list, all int32 and indexed by the posting number
+ */
+enum {
+    COL_UTT,
+    COL_SF,
+    COL_EF,
+    COL_ALPHA,
+    COL_BETA,
+    COL_ASCR,
+    COL_NORM,
+    COL_FROM_ID,
+    COL_TO_ID,
+    COL_NEXT_WID,
+    N_COLUMN
+};
+
+/**
+ * postings_t
+ * Hits of one word stored column by column and ordered by (utterance, start frame).
+ * When **n_alloc** is 0 the columns point into a mapped binary index and are copied
+ * to the heap on the first append or sort.
+ */
+typedef struct postings_s {
+    int32 n_hit;
+    int32 n_alloc;
+    int32 unsorted;     /** set when appends broke the order, the list is sorted before a search */
+    int32* col[N_COLUMN];
+} postings_t;
+
+/**
+ * Sort key of a posting. A link is identified by its utterance and end nodes, so
+ * the order does not depend on the order the hits came in; **pos** breaks the
+ * remaining ties between duplicates.
+ */
+typedef struct posting_key_s {
+    int32 utt;
+    int32 sf;
+    int32 ef;
+    int32 from_id;
+    int32 to_id;
+    int32 pos;
+} posting_key_t;
+
+/**
+ * Binary index layout, all sections 4-byte aligned and in host byte order; offsets are 64-bit
+ * so that an archive may grow past 4 GiB:
+ *
+ *   bin_header_t
+ *   bin_word_t  [n_word]   word name plus the offset and size of its column block
+ *   columns                per word, N_COLUMN arrays of n_hit int32 in column order
+ *   uttdict     [utts_size]     interned utterance ids, see uttdict_write()
+ *
+ * The file is mmap()'d by inverted_index_read_bin() and the columns are served
+ * in place, so nothing is parsed or allocated per hit at load time.
+ */
+typedef struct bin_header_s {
+    char magic[8];
+    uint32 version;
+    uint32 n_word;
+    uint32 n_hit;
+    uint32 utts_size;
+    uint64_t word_off;  /** file offset of the word table */
+    uint64_t utts_off;  /** file offset of the utterance dictionary */
+    int32 frate;        /** frames per second of sf/ef */
+    uint32 flags;       /** INDEX_BIN_SORTED if every posting list is in (utterance, start frame) order */
+} bin_header_t;
+
+typedef struct bin_word_s {
+    char word[WORD_MAX_LENGTH + 1];
+    uint32 n_hit;   /** number of postings of this word */
+    uint32 reserved;
+    uint64_t off;   /** file offset of its first column */
+} bin_word_t;
+
+/**
+ * bigram_t
+ * Bigram log-probabilities between words, prob[prev * n_word + next], under **lm**;
+ * indexes over the same word list may share one table.
+ */
+typedef struct bigram_s {
+    int refcount;
+    ngram_model_t* lm;
+    int32* prob;
+} bigram_t;
+
 /** 
  * inverted_index_t 
  */
 struct inverted_index_s {
     int n_word; /** total number of real words in dictionary, here word refers to syllable */
-    char** word_list;  /** word list */
-    hit_t** first_hits; /** each element inside points to the first hit of that WORD*/
-    hit_t** last_hits;  /** each element inside points to the last hit of that WORD*/
-};
+    vocab_t* vocab;    /** word list, may be shared with other indexes */
+    postings_t* postings;   /** posting columns of each WORD */
+    int32 n_hit;        /** total number of postings */
+    int32 frate;        /** frames per second of the hit times */
+    int frate_fixed;    /** set under **lock** by the first publication, before its hits are counted */
+    uttdict_t* utts;    /** utterance ids referred to by the hits */
+    
+    bigram_t* bigram;   /** built by inverted_index_set_lm(), NULL before */
+    
+    float64 min_posterior;      /** links less likely than this are not indexed, 0 keeps all */
+    float32 max_hits_per_sec;   /** hits kept per second of audio, the most likely first; 0 for no cap */
+    int collapse;               /** merge the overlapping hits of a word within an utterance */
+    inverted_index_stats_t stats;
 
+    void* map;          /** mmap()'d binary index the columns may point into, NULL if none */
+    size_t map_size;
+    
+    /**
+     * taken by inverted_index_publish(): **lock** for the frame rate and the counts, a stripe per
+     * word; the dictionary has its own lock
+     */
+    pthread_mutex_t lock;
+    pthread_mutex_t stripes[N_STRIPE];
+};
 
 /**
  * partial_path_t
+ * One node per term. A path is immutable once built and shares its prefix with the
+ * path it extends, so extending costs one node; nodes live in the arena of the query.
  */
 typedef struct partial_path_s {
-    hit_t* first_term;
-    hit_t* last_term;
+    hit_t term;         /** last term of the path */
+    struct partial_path_s *parent;  /** the path without its last term, NULL for the first term */
+    struct partial_path_s *first;   /** node of the first term */
     int n_term;
+    int32 fwd;          /** alpha of the first term, less the normalizer, plus the scores of the links so far */
 	int32 post;
-    struct partial_path_s *next;
+    struct partial_path_s *next;    /** next path in the queue */
 } partial_path_t;
 
 /**
@@ -62,172 +187,238 @@ typedef struct path_queue_s {
 } path_queue_t;
 
 
-/**
- * result_t
- */
-typedef struct result_s {
-    char* uttid;
-    int32 similarity;
-    struct result_s* next;
-} result_t;
+/* =====================================================================
+ * postings_t's function definitions 
+ * ===================================================================== */
 
-struct result_list_s {
-    int n_result;
-    result_t *first;
-};
+static void postings_free(postings_t* p)
+{
+    int c;
+    if (p->n_alloc == 0) 
+        return;     /** empty, or served from the mapping */
+    for (c = 0; c < N_COLUMN; c++) {
+        free(p->col[c]);
+    }
+}
 
-void result_list_free(result_list_t* rl)
+/** Make room for **n** postings on the heap, copying mapped columns if needed */
+static void postings_reserve(postings_t* p, int32 n)
 {
-    if (!rl)
+    int c;
+    int32 n_alloc;
+    int32* col;
+    if (n <= p->n_alloc)
         return;
-    result_t* r;
-    for (r = rl->first; r; r = r->next) {
-        free(r->uttid);
-        free(r);
-        rl->n_result--;
+    for (n_alloc = p->n_alloc ? p->n_alloc : POSTINGS_INIT_SIZE; n_alloc < n; n_alloc *= 2)
+        ;
+    for (c = 0; c < N_COLUMN; c++) {
+        if (p->n_alloc == 0) {
+            col = (int32*) malloc(n_alloc * sizeof(int32));
+            if (p->n_hit > 0)
+                memcpy(col, p->col[c], p->n_hit * sizeof(int32));
+        } else {
+            col = (int32*) realloc(p->col[c], n_alloc * sizeof(int32));
+        }
+        p->col[c] = col;
     }
-    
-    free(rl);
+    p->n_alloc = n_alloc;
 }
 
-/* =====================================================================
- * partial_path_t's function definitions 
- * ===================================================================== */
+static void postings_append(postings_t* p, const hit_t* hit)
+{
+    int32 i = p->n_hit;
+    postings_reserve(p, i + 1);
+    p->col[COL_UTT][i] = hit->utt;
+    p->col[COL_SF][i] = hit->sf;
+    p->col[COL_EF][i] = hit->ef;
+    p->col[COL_ALPHA][i] = hit->alpha;
+    p->col[COL_BETA][i] = hit->beta;
+    p->col[COL_ASCR][i] = hit->ascr;
+    p->col[COL_NORM][i] = hit->norm;
+    p->col[COL_FROM_ID][i] = hit->from_id;
+    p->col[COL_TO_ID][i] = hit->to_id;
+    p->col[COL_NEXT_WID][i] = hit->next_wid;
+    p->n_hit++;
+}
 
-/** Initialize an empty path */ 
-partial_path_t* partial_path_init() {
-    partial_path_t* p;
-    p = (partial_path_t*) malloc( sizeof(partial_path_t) );
-    p->first_term = NULL;
-    p->last_term = NULL;
-    p->next = NULL;
-    p->n_term = 0;  
-    return p;
+static int posting_key_cmp(const void* a, const void* b)
+{
+    const posting_key_t* x = (const posting_key_t*) a;
+    const posting_key_t* y = (const posting_key_t*) b;
+    if (x->utt != y->utt)
+        return (x->utt < y->utt) ? -1 : 1;
+    if (x->sf != y->sf)
+        return (x->sf < y->sf) ? -1 : 1;
+    if (x->ef != y->ef)
+        return (x->ef < y->ef) ? -1 : 1;
+    if (x->from_id != y->from_id)
+        return (x->from_id < y->from_id) ? -1 : 1;
+    if (x->to_id != y->to_id)
+        return (x->to_id < y->to_id) ? -1 : 1;
+    return (x->pos < y->pos) ? -1 : (x->pos > y->pos);
 }
 
-/** Finitialize a path */ 
-void partial_path_free(partial_path_t* p) 
-{
-    if (p) {
-        hit_t* h;
-        while (p->first_term) {
-            h = p->first_term;
-            p->first_term = p->first_term->next;
-            /** Don't forget to free the **uttid**,**word** and **subseq_word** member in hit_t */
-            free(h->uttid); 
-            free(h->word);
-            free(h->subseq_word);
-            free(h);
-            p->n_term--;
-        }
-        free(p);
-    }
+/** Sort key of posting **i** */
+static void postings_key(postings_t* p, int32 i, posting_key_t* key)
+{
+    key->utt = p->col[COL_UTT][i];
+    key->sf = p->col[COL_SF][i];
+    key->ef = p->col[COL_EF][i];
+    key->from_id = p->col[COL_FROM_ID][i];
+    key->to_id = p->col[COL_TO_ID][i];
+    key->pos = 0;
 }
 
-/** Extend the path with a new term */
-int partial_path_extend(partial_path_t* p, hit_t* h) 
+/** Nonzero if posting **i** comes before posting **j** */
+static int postings_less(postings_t* p, int32 i, int32 j)
 {
-    if (!p) 
-        return -1;
-    if (!h)
-        return -1;
+    posting_key_t x, y;
+    postings_key(p, i, &x);
+    postings_key(p, j, &y);
+    return posting_key_cmp(&x, &y) < 0;
+}
 
-    hit_t* hit;
-    hit = (hit_t*) malloc(sizeof(hit_t));
-    
-    hit->uttid = (char*) malloc(MAX_LINE_LENGTH * sizeof(char));
-    memset(hit->uttid, 0, MAX_LINE_LENGTH * sizeof(char));
-    strncpy(hit->uttid, h->uttid, strlen(h->uttid));
-    
-    hit->norm = h->norm;
-    
-    hit->wid = h->wid;
-    hit->word = (char*) malloc( (WORD_MAX_LENGTH+1) * sizeof(char));
-    memset(hit->word, 0, (WORD_MAX_LENGTH+1) * sizeof(char));
-    strncpy(hit->word, h->word, strlen(h->word));
-    
-    hit->subseq_word = (char*) malloc( (WORD_MAX_LENGTH+1) * sizeof(char));
-    memset(hit->subseq_word, 0, (WORD_MAX_LENGTH+1) * sizeof(char));
-    strncpy(hit->subseq_word, h->subseq_word, strlen(h->subseq_word));
-    
-    hit->start_time = h->start_time;
-    hit->end_time = h->end_time;
-    hit->alpha = h->alpha;
-    hit->beta = h->beta;
-    hit->ascr = h->ascr;
-    hit->next = NULL;
+/**
+ * Sort the postings from **from** to the end, e.g. the hits just added from one
+ * lattice, and keep track of whether the whole list is still in order.
+ */
+static void postings_sort_run(postings_t* p, int32 from)
+{
+    int c;
+    int32 i, n = p->n_hit - from;
+    posting_key_t* keys;
+    int32* tmp;
     
-    if (p->n_term == 0) {
-        p->first_term = hit;
-    } else {
-        p->last_term->next = hit;
+    for (i = from + 1; i < p->n_hit && !postings_less(p, i, i - 1); i++)
+        ;
+    if (i < p->n_hit) {
+        postings_reserve(p, p->n_hit);
+        keys = (posting_key_t*) malloc(n * sizeof(posting_key_t));
+        for (i = 0; i < n; i++) {
+            postings_key(p, from + i, &keys[i]);
+            keys[i].pos = i;
+        }
+        qsort(keys, n, sizeof(posting_key_t), posting_key_cmp);
+        
+        /** apply the permutation column by column */
+        tmp = (int32*) malloc(n * sizeof(int32));
+        for (c = 0; c < N_COLUMN; c++) {
+            for (i = 0; i < n; i++) {
+                tmp[i] = p->col[c][from + keys[i].pos];
+            }
+            memcpy(p->col[c] + from, tmp, n * sizeof(int32));
+        }
+        free(tmp);
+        free(keys);
     }
-    p->last_term = hit;
-    p->n_term++;
-    
-    return 0;
+    if (from == 0) {
+        p->unsorted = 0;
+    } else if (n > 0 && postings_less(p, from, from - 1)) {
+        p->unsorted = 1;
+    }
+}
+
+/** First posting at or after **from** that is not before (**utt**, **sf**), galloping from **from** */
+static int32 postings_lower_bound(postings_t* p, int32 from, int32 utt, int32 sf)
+{
+    const int32* u = p->col[COL_UTT];
+    const int32* s = p->col[COL_SF];
+    int32 lo = from, hi, step = 1, mid;
     
+    /** gallop to bracket the answer in [lo, hi) */
+    hi = from;
+    while (hi < p->n_hit && (u[hi] < utt || (u[hi] == utt && s[hi] < sf))) {
+        lo = hi + 1;
+        hi += step;
+        step *= 2;
+    }
+    if (hi > p->n_hit)
+        hi = p->n_hit;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (u[mid] < utt || (u[mid] == utt && s[mid] < sf)) 
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
 }
 
-/** Genarete a new path from an existing one */
-partial_path_t* partial_path_copy(partial_path_t* p) {
-       if (!p) {
-           return NULL;
-       }
-       
-       hit_t* h;
-       partial_path_t* out = partial_path_init();
-       for (h = p->first_term; h; h = h->next) {
-            if (partial_path_extend(out, h) != 0) {
-                perror("Add hits to path failure");
-                partial_path_free(out);
-                return NULL;
-            }
-       }
-	   out->post = p->post;
-       out->next = NULL;
-       return out;
+/** Unpack posting **i** of word **wid** into **hit** */
+static void postings_get(postings_t* p, int wid, int32 i, hit_t* hit)
+{
+    hit->utt = p->col[COL_UTT][i];
+    hit->norm = p->col[COL_NORM][i];
+    hit->wid = wid;
+    hit->next_wid = p->col[COL_NEXT_WID][i];
+    hit->from_id = p->col[COL_FROM_ID][i];
+    hit->to_id = p->col[COL_TO_ID][i];
+    hit->sf = p->col[COL_SF][i];
+    hit->ef = p->col[COL_EF][i];
+    hit->alpha = p->col[COL_ALPHA][i];
+    hit->beta = p->col[COL_BETA][i];
+    hit->ascr = p->col[COL_ASCR][i];
+    hit->next = NULL;
 }
 
+/* =====================================================================
+ * partial_path_t's function definitions 
+ * ===================================================================== */
 
-/** Get posterior log-likelihood of the partial path: P(path|O) */
-int32 partial_path_get_posterior(partial_path_t* p, ngram_model_t* lm, float32 ascale)
+/** Extend **parent** with a new term; a NULL **parent** starts a new path */
+partial_path_t* partial_path_extend(partial_path_t* parent, hit_t* h, arena_t* arena) 
 {
-    hit_t *hit, *subseq_hit;
-    int32 n_used;
-    int32 result;
-    if (p) {
-        // p->n_term >= 0
-        switch(p->n_term) {
-            case 0:
-                return 0;
-            case 1:
-                return p->first_term->alpha + p->first_term->beta - p->first_term->norm;
-            default:
-                result = p->first_term->alpha + p->last_term->beta - p->first_term->norm;
-                for (hit = p->first_term, subseq_hit = p->first_term->next;
-                        hit && subseq_hit; 
-                        hit = hit->next, subseq_hit = subseq_hit->next) {
-                    result = result 
-                            + ngram_score_to_prob(lm, ngram_bg_score(lm, ngram_wid(lm, subseq_hit->word), ngram_wid(lm, hit->word), &n_used))
-                            + (subseq_hit->ascr << SENSCR_SHIFT) * ascale;         
-                }
-                return result;
-        }   
+    partial_path_t* p;
+    if (!h)
+        return NULL;
+    if ( (p = (partial_path_t*) arena_alloc(arena, sizeof(partial_path_t))) == NULL)
+        return NULL;
+    p->term = *h;
+    p->term.next = NULL;
+    p->parent = parent;
+    p->first = parent ? parent->first : p;
+    p->n_term = parent ? parent->n_term + 1 : 1;
+    p->fwd = 0;
+    p->post = 0;
+    p->next = NULL;
+    return p;
+}
+
+
+/**
+ * Get posterior log-likelihood of the partial path: P(path|O)
+ * The forward part of the score is kept in the path and extended from the parent's,
+ * so the parent must have been scored first.
+ */
+int32 partial_path_get_posterior(partial_path_t* p, inverted_index_t* index, float32 ascale)
+{
+    if (!p)
+        return 0;
+    if (!p->parent) {
+        p->fwd = p->term.alpha - p->term.norm;
+    } else {
+        p->fwd = p->parent->fwd 
+                + index->bigram->prob[p->parent->term.wid * index->n_word + p->term.wid]
+                + (int32) ((p->term.ascr << SENSCR_SHIFT) * ascale);
     }
-    return 0;
+    return p->fwd + p->term.beta;
 }
 
+/** Print the words of the path, first term first */
+static void partial_path_print_words(partial_path_t* p, vocab_t* vocab)
+{
+    if (p->parent)
+        partial_path_print_words(p->parent, vocab);
+    printf("%s ", vocab_word(vocab, p->term.wid));
+}
 
-void partial_path_print(partial_path_t* p)
+void partial_path_print(partial_path_t* p, inverted_index_t* index)
 {
     if (!p)
         return;
-    hit_t* h;
-    printf("%s[%.2f-%.2f] ", p->first_term->uttid, p->first_term->start_time, p->last_term->end_time);
-    for (h = p->first_term; h; h = h->next) {
-        printf("%s ", h->word);
-    }
+    printf("%s[%.2f-%.2f] ", uttdict_str(index->utts, p->first->term.utt),
+        (double) p->first->term.sf / index->frate, (double) p->term.ef / index->frate);
+    partial_path_print_words(p, index->vocab);
     printf("%d\n", p->post);
 }
 
@@ -235,34 +426,22 @@ void partial_path_print(partial_path_t* p)
  * path_queue_t's function definitions 
  * ===================================================================== */ 
  
-path_queue_t* path_queue_init() 
+/** A queue and its paths live in **arena**, they are dropped with it */
+path_queue_t* path_queue_init(arena_t* arena) 
 {
-    path_queue_t* q = (path_queue_t*) malloc( sizeof(path_queue_t) );
+    path_queue_t* q = (path_queue_t*) arena_alloc(arena, sizeof(path_queue_t) );
     q->head = q->tail = NULL;
     q->n_path = 0;
     return q;
 }
 
-void path_queue_free(path_queue_t* q)
-{
-    if (!q) return;
-    partial_path_t* p;
-    while (q->head) {
-        p = q->head;
-        q->head = q->head->next;
-        partial_path_free(p);
-        q->n_path--;
-    }
-    free(q);    
-}
-
-void path_queue_print(path_queue_t* q)
+void path_queue_print(path_queue_t* q, inverted_index_t* index)
 {
     if(!q)
         return;
     partial_path_t* p = q->head;
     while (p) {
-        partial_path_print(p);
+        partial_path_print(p, index);
         p = p->next;
     }
 }
@@ -295,142 +474,201 @@ void path_queue_add(path_queue_t* q, partial_path_t* p) {
     q->n_path++;
 }
 
-void path_queue_sort(path_queue_t** q)
-{
-	path_queue_t* q_sorted = path_queue_init();
-	path_queue_add(q_sorted, partial_path_copy((*q)->head)); 
-	
-	partial_path_t *i, *j, *j_prev;
-	for (i = (*q)->head->next; i; i = i->next) {
-		
-		for (j = q_sorted->head; j; j = j->next) {
-			if (i->post > j->post) {
-				partial_path_t *new_i = partial_path_copy(i);
-				if ( j == q_sorted->head) {					
-					q_sorted->head = new_i;					
-				} else {
-					j_prev->next = new_i;
-				}
-				new_i->next = j;
-				q_sorted->n_path++;
-				break;
-			} else {
-				j_prev = j;
-			}
-		}
-		// add to the tail
-		if ( j_prev == q_sorted->tail) {
-			path_queue_add(q_sorted, partial_path_copy(i)); 
-		} 
-	}
-	
-	path_queue_free(*q);
-	*q = q_sorted; 
+/**
+ * Select the **n_best** paths with the highest posterior, all of them if **n_best** <= 0.
+ * **top** receives them best first, ties in queue order, allocated from **arena** like the
+ * heap used to rank them; the paths themselves stay in the queue. Returns the number of
+ * paths selected.
+ */
+int path_queue_top(path_queue_t* q, int n_best, partial_path_t*** top, arena_t* arena)
+{
+    int n = 0, k, seq = 0;
+    partial_path_t* p;
+    result_rank_t* heap;
+    
+    k = (n_best <= 0 || n_best > q->n_path) ? q->n_path : n_best;
+    *top = (partial_path_t**) arena_alloc(arena, (k ? k : 1) * sizeof(partial_path_t*));
+    if (k == 0)
+        return 0;
+    heap = (result_rank_t*) arena_alloc(arena, k * sizeof(result_rank_t));
+    for (p = q->head; p; p = p->next) {
+        n = result_rank_add(heap, n, k, p, p->post, seq++);
+    }
+    result_rank_sort(heap, n);
+    for (n = 0; n < k; n++) {
+        (*top)[n] = (partial_path_t*) heap[n].item;
+    }
+    return k;
 }
 
 /* =====================================================================
  * inverted_index's functons
  * ===================================================================== */
  
-inverted_index_t* inverted_index_init(const char* filename)
+/** Drop a reference to a bigram table, indexes sharing it may be freed from different threads */
+static void bigram_release(bigram_t* bigram)
+{
+    if (!bigram || __sync_sub_and_fetch(&(bigram->refcount), 1) > 0)
+        return;
+    free(bigram->prob);
+    free(bigram);
+}
+
+/** Allocate an empty index over **n_word** words, taking over the reference to **vocab** */
+static inverted_index_t* inverted_index_alloc(vocab_t* vocab, int n_word)
 {
     int i;
-    FILE* fh;
-    char s[WORD_MAX_LENGTH + 2] = {'\0',};
-    
-    fh = fopen(filename, "r");    
-    if (fh == NULL) {
-        perror("Failed to open Word List file.");
-        return NULL;
-    }
-    
     inverted_index_t* index = (inverted_index_t*) malloc(sizeof(inverted_index_t));
-    index->n_word = 0;
-    
-    while ((fgets(s, WORD_MAX_LENGTH + 2, fh) != '\0')) {
-        index->n_word++;
-	    //printf("%d: %s", index->n_word, s); 
-    }
-    index->word_list = (char**) malloc(index->n_word * sizeof(char*));
-    for (i = 0; i < index->n_word; i++) {
-        index->word_list[i] = (char*) malloc( (WORD_MAX_LENGTH + 1) * sizeof(char));
-        memset(index->word_list[i], 0, (WORD_MAX_LENGTH + 1) * sizeof(char));
-    }
-    fseek(fh, 0, SEEK_SET);
-    i = 0;
-    while ((fgets(s, WORD_MAX_LENGTH + 2, fh) != '\0')) {
-        strncpy(index->word_list[i], strtok(s, "\n"), WORD_MAX_LENGTH);
-	    //printf("%s", index->word_list[i]);	    
-	    i++;
-    }
-    fclose(fh);
+    index->n_word = n_word;
+    index->vocab = vocab;
     
     /** allocate memory for index */
-    index->first_hits = (hit_t**) malloc(index->n_word * sizeof(hit_t*));
-    for (i = 0; i < index->n_word; i++) {
-        index->first_hits[i] = NULL;
+    index->postings = (postings_t*) calloc(index->n_word, sizeof(postings_t));
+    index->n_hit = 0;
+    index->frate = DEFAULT_FRATE;
+    index->frate_fixed = 0;
+    index->utts = uttdict_init();
+    index->bigram = NULL;
+    index->min_posterior = 0;
+    index->max_hits_per_sec = 0;
+    index->collapse = 0;
+    memset(&(index->stats), 0, sizeof(inverted_index_stats_t));
+    index->map = NULL;
+    index->map_size = 0;
+    pthread_mutex_init(&(index->lock), NULL);
+    for (i = 0; i < N_STRIPE; i++) {
+        pthread_mutex_init(&(index->stripes[i]), NULL);
     }
-    index->last_hits = (hit_t**) malloc(index->n_word * sizeof(hit_t*));
-    for (i = 0; i < index->n_word; i++) {
-        index->last_hits[i] = NULL;
+    return index;
+}
+
+inverted_index_t* inverted_index_init_vocab(vocab_t* vocab)
+{
+    if (!vocab) 
+        return NULL;
+    return inverted_index_alloc(vocab_retain(vocab), vocab_size(vocab));
+}
+
+inverted_index_t* inverted_index_init(const char* filename)
+{
+    vocab_t* vocab;
+    inverted_index_t* index;
+    
+    if ( (vocab = vocab_read(filename)) == NULL) {
+        return NULL;
     }
+    index = inverted_index_init_vocab(vocab);
+    vocab_free(vocab);
     return index;
 }
 
 void inverted_index_free(inverted_index_t* index)
 {
     int i;
-    hit_t* p;
     
     for(i = 0; i < index->n_word; i++) {
-        free(index->word_list[i]);
-    }
-        
-    for(i = 0; i < index->n_word; i++) {
-        if (index->first_hits[i] == NULL && index->last_hits[i] == NULL)
-            continue;   // no hits in this WORD, skip to next WORD
-        // delete each hit from first hit to last
-        while(index->first_hits[i]) {
-            p = index->first_hits[i];
-            index->first_hits[i] = index->first_hits[i]->next;
-            free(p->uttid);
-            free(p->word);
-            free(p->subseq_word);
-            free(p);    
-        }
-        index->last_hits[i] = NULL;
+        postings_free(&(index->postings[i]));
     }
     
-    free(index->word_list);
-    free(index->first_hits);
-    free(index->last_hits);
+    if (index->map) {
+        munmap(index->map, index->map_size);
+    }
+    uttdict_free(index->utts);
+    vocab_free(index->vocab);
+    free(index->postings);
+    bigram_release(index->bigram);
+    pthread_mutex_destroy(&(index->lock));
+    for (i = 0; i < N_STRIPE; i++) {
+        pthread_mutex_destroy(&(index->stripes[i]));
+    }
     free(index);
     printf("Finialize index Successfully\n");
 }
 
+uttdict_t* inverted_index_get_uttdict(inverted_index_t* index)
+{
+    return index->utts;
+}
+
+int inverted_index_set_uttdict(inverted_index_t* index, uttdict_t* utts)
+{
+    if (index->map || index->n_hit > 0) {
+        return -1;  /** ordinals of existing hits belong to the old dictionary */
+    }
+    uttdict_free(index->utts);
+    index->utts = uttdict_retain(utts);
+    return 0;
+}
+
 int inverted_index_get_wid(inverted_index_t* index, const char* word)
 {
-    int i;
-    int len = strlen(word);
+    return vocab_wid(index->vocab, word); /**  -1 if **word** not found in the word_list */
+}
+
+vocab_t* inverted_index_get_vocab(inverted_index_t* index)
+{
+    return index->vocab;
+}
+
+void inverted_index_set_lm(inverted_index_t* index, ngram_model_t* lm)
+{
+    int i, j;
+    int32 n_used;
+    int32* lm_wids;
+    bigram_t* bigram;
     
+    if (index->bigram && lm == index->bigram->lm)
+        return;
+    /** map the vocabulary to the lm once, then score every word pair */
+    lm_wids = (int32*) malloc(index->n_word * sizeof(int32));
     for (i = 0; i < index->n_word; i++) {
-        if ( len == strlen(index->word_list[i]) 
-            && strncmp(word, index->word_list[i], len ) == 0 ) 
-            break;
+        lm_wids[i] = ngram_wid(lm, vocab_word(index->vocab, i));
     }
-    
-    if ( i < index->n_word ) 
-        return i;
-    else
-        return -1; /**  **word** not found in the word_list */
+    bigram = (bigram_t*) malloc(sizeof(bigram_t));
+    bigram->refcount = 1;
+    bigram->lm = lm;
+    bigram->prob = (int32*) malloc((size_t) index->n_word * index->n_word * sizeof(int32));
+    for (i = 0; i < index->n_word; i++) {
+        for (j = 0; j < index->n_word; j++) {
+            bigram->prob[i * index->n_word + j] = 
+                ngram_score_to_prob(lm, ngram_bg_score(lm, lm_wids[j], lm_wids[i], &n_used));
+        }
+    }
+    free(lm_wids);
+    bigram_release(index->bigram);
+    index->bigram = bigram;
+}
+
+int inverted_index_share_lm(inverted_index_t* index, inverted_index_t* from)
+{
+    if (!from->bigram || index->n_word != from->n_word) {
+        perror("inverted_index_share_lm: no bigram table for this word list");
+        return -1;
+    }
+    __sync_fetch_and_add(&(from->bigram->refcount), 1);
+    bigram_release(index->bigram);
+    index->bigram = from->bigram;
+    return 0;
+}
 
+void inverted_index_freeze(inverted_index_t* index, ngram_model_t* lm)
+{
+    int i;
+    for (i = 0; i < index->n_word; i++) {
+        if (index->postings[i].unsorted) 
+            postings_sort_run(&(index->postings[i]), 0);
+    }
+    inverted_index_set_lm(index, lm);
 }
 
 int inverted_index_write(inverted_index_t* index, const char* filename)
 {
     FILE* fp;
     int i;
-    hit_t* hit;
+    int32 j;
+    hit_t hit;
+    const char* subseq_word;
+    double frate = index->frate;
     
     if ( (fp = fopen(filename, "w")) == NULL) {
         perror("Failed to open file");
@@ -438,14 +676,18 @@ int inverted_index_write(inverted_index_t* index, const char* filename)
     }
     
     //fprintf(fp, "# Index by Jiada\n");
-    fprintf(fp, "# Words: %d\n\n", index->n_word);
+    fprintf(fp, "# Words: %d\n", index->n_word);
+    fprintf(fp, "# Frate: %d\n\n", index->frate);
     
     for (i = 0; i < index->n_word; i++) {
-        fprintf(fp, "%d:%s\n", i, index->word_list[i]);
-        for (hit = index->first_hits[i]; hit; hit = hit->next) {
+        fprintf(fp, "%d:%s\n", i, vocab_word(index->vocab, i));
+        for (j = 0; j < index->postings[i].n_hit; j++) {
+            postings_get(&(index->postings[i]), i, j, &hit);
+            if ( (subseq_word = vocab_word(index->vocab, hit.next_wid)) == NULL)
+                subseq_word = "-";
             fprintf(fp, "(%s, %.2f, %.2f, %d, %d, %d, %d, %d, %d, %s)\n",
-                hit->uttid, hit->start_time, hit->end_time,
-                hit->ascr, hit->alpha, hit->beta, hit->norm, hit->from_id, hit->to_id, hit->subseq_word);
+                uttdict_str(index->utts, hit.utt), hit.sf / frate, hit.ef / frate,
+                hit.ascr, hit.alpha, hit.beta, hit.norm, hit.from_id, hit.to_id, subseq_word);
         }
     }
     
@@ -453,130 +695,366 @@ int inverted_index_write(inverted_index_t* index, const char* filename)
     return 0;
 }
 
+/**
+ * The text index is read in two passes: the word lines first, so that the
+ * vocabulary exists when the successor words of the hits are looked up.
+ */
 inverted_index_t* inverted_index_read(const char* filename)
 { 
     FILE* fp;
     int i, k;
     int n_word;
+    int error = 0;
     char line[MAX_LINE_LENGTH] = {'\0',}; 
     inverted_index_t* index;
+    char** words;
     
-    int wid, from_id, to_id;
+    int wid = -1, from_id, to_id;
+    int frate = DEFAULT_FRATE;
     char word[MAX_LINE_LENGTH] = {'\0',};
     char subseq_word[MAX_LINE_LENGTH] = {'\0',};
     char uttid[MAX_LINE_LENGTH] = {'\0',};
     float st, et;
     int32 norm, ascr, alpha, beta;
+    long body;
     
-    hit_t* hit;
+    hit_t hit;
     
     if ( (fp = fopen(filename, "r")) == NULL) {
         perror("Failed to open file.");
         return NULL;
     }
-    /** Get total number of words */
-    fscanf(fp, "# Words: %d\n\n", &n_word);
+    /** Get total number of words, the frame rate line is optional (older dumps are at 100) */
+    if (fscanf(fp, "# Words: %d\n", &n_word) != 1 || n_word < 0) {
+        perror("Format Error");
+        fclose(fp);
+        return NULL;
+    }
+    if (fscanf(fp, "# Frate: %d\n", &frate) == 1 && frate <= 0) {
+        perror("Format Error");
+        fclose(fp);
+        return NULL;
+    }
+    body = ftell(fp);
     //printf("words: %d\n", n_word);
-    /** allocate space to store index*/
-    index = (inverted_index_t*) malloc(sizeof(inverted_index_t));
-    index->n_word = n_word;
-    /** word list */
-    index->word_list = (char**) malloc(index->n_word * sizeof(char*));
-    for (i = 0; i < index->n_word; i++) {
-        index->word_list[i] = (char*) malloc( (WORD_MAX_LENGTH + 1) * sizeof(char));
-        memset(index->word_list[i], 0, (WORD_MAX_LENGTH + 1) * sizeof(char));
+    
+    /** first pass: the word list */
+    words = (char**) calloc(n_word, sizeof(char*));
+    while ( NULL != fgets(line, MAX_LINE_LENGTH, fp)) {
+        if (line[0] == '(')
+            continue;
+        if ( sscanf(line, "%d:%s\n", &wid, word) != 2 || wid < 0 || wid >= n_word) {
+            perror("Format Error");
+            error = 1;
+            break;
+        }
+        free(words[wid]);
+        words[wid] = (char*) calloc(WORD_MAX_LENGTH + 1, sizeof(char));
+        strncpy(words[wid], word, WORD_MAX_LENGTH);
     }
-    /** allocate memory for hits */
-    index->first_hits = (hit_t**) malloc(index->n_word * sizeof(hit_t*));
-    for (i = 0; i < index->n_word; i++) {
-        index->first_hits[i] = NULL;
+    
+    /** words missing from the file become empty, unreachable entries */
+    for (i = 0; i < n_word; i++) {
+        if (!words[i]) 
+            words[i] = (char*) calloc(1, sizeof(char));
     }
-    index->last_hits = (hit_t**) malloc(index->n_word * sizeof(hit_t*));
-    for (i = 0; i < index->n_word; i++) {
-        index->last_hits[i] = NULL;
+    index = inverted_index_alloc(vocab_init((const char* const*) words, n_word), n_word);
+    index->frate = frate;
+    for (i = 0; i < n_word; i++) {
+        free(words[i]);
     }
+    free(words);
     
-    while ( NULL != fgets(line, MAX_LINE_LENGTH, fp)) {
+    /** second pass: the hits of each word */
+    fseek(fp, body, SEEK_SET);
+    wid = -1;
+    while ( !error && NULL != fgets(line, MAX_LINE_LENGTH, fp)) {
         if ( ( (k = sscanf(line, "%d:%s\n", &wid, word)) != 2) 
-            && ( (k = sscanf(line, "(%[a-z], %f, %f, %d, %d, %d, %d, %d, %d, %s)\n",
+            && ( (k = sscanf(line, "(%[^,], %f, %f, %d, %d, %d, %d, %d, %d, %[^)])\n",
                         uttid, &st, &et, &ascr, &alpha, &beta, &norm, &from_id, &to_id, subseq_word)) != 10) ) 
         {
             //printf("k=%d %s", k, line);
             perror("Format Error");
-            inverted_index_free(index);
-            return NULL;    
-        }
-        
-        if ( k == 2) {
-            strncpy(index->word_list[wid], word, WORD_MAX_LENGTH);
-            //printf("%s\n", index->word_list[wid]);           
+            error = 1;
+            break;
         }
         
         if ( k == 10) {
+            if (wid < 0) {
+                perror("Format Error");
+                error = 1;
+                break;
+            }
             //printf("(%d:%s %s, %.2f, %.2f, %d, %d, %d)\n", wid, word, uttid, st, et, ascr, alpha, beta); 
             
             // add a new hit 
-            
-            hit = (hit_t*) malloc(sizeof(hit_t));
-            hit->uttid = (char*) malloc(MAX_LINE_LENGTH * sizeof(char));
-            memset(hit->uttid, 0, MAX_LINE_LENGTH * sizeof(char));
-            strncpy(hit->uttid, uttid, strlen(uttid));
-            
-            hit->norm = norm;
-            
-            hit->wid = wid;
-            hit->word = (char*) malloc( (WORD_MAX_LENGTH+1) * sizeof(char));
-            memset(hit->word, 0, (WORD_MAX_LENGTH+1) * sizeof(char));
-            strncpy(hit->word, word, strlen(word));
-            
-            hit->from_id = from_id;
-            hit->to_id = to_id;
-            
-            hit->subseq_word = (char*) malloc( (WORD_MAX_LENGTH+1) * sizeof(char));
-            memset(hit->subseq_word, 0, (WORD_MAX_LENGTH+1) * sizeof(char));
-            strncpy(hit->subseq_word, subseq_word, strlen(subseq_word));
-            
-            hit->start_time = (double) st;
-            hit->end_time = (double) et;
-            hit->alpha = alpha;
-            hit->beta = beta;
-            hit->ascr = ascr;
-            hit->next = NULL;
-            if (index->first_hits[wid] == NULL) {
-                index->first_hits[wid] = hit;
-            } else {
-                index->last_hits[wid]->next = hit;
-            }
-        
-            index->last_hits[wid] = hit;            
+            hit.utt = uttdict_intern(index->utts, uttid);
+            hit.norm = norm;
+            hit.wid = wid;
+            hit.next_wid = inverted_index_get_wid(index, subseq_word);
+            hit.from_id = from_id;
+            hit.to_id = to_id;
+            /** times were printed with two decimals, round them back to frames */
+            hit.sf = (int32) (st * frate + 0.5);
+            hit.ef = (int32) (et * frate + 0.5);
+            hit.alpha = alpha;
+            hit.beta = beta;
+            hit.ascr = ascr;
+            postings_append(&(index->postings[wid]), &hit);
+            index->n_hit++;
         }
         
     }
-
     fclose(fp);
+    
+    if (error) {
+        inverted_index_free(index);
+        return NULL;
+    }
+    /** a dump of an older index may be out of order */
+    for (i = 0; i < n_word; i++) {
+        postings_sort_run(&(index->postings[i]), 0);
+    }
     return index;    
 }
 
-/** Add new hits from a lattice */
-void inverted_index_addhits(inverted_index_t* index, const char* uttid, ps_lattice_t* lat, float32 ascale)
+int inverted_index_write_bin(inverted_index_t* index, const char* filename)
+{
+    FILE* fp;
+    int i, c;
+    postings_t* p;
+    bin_header_t header;
+    bin_word_t* words;
+    uint64_t off;
+    
+    if ( (fp = fopen(filename, "wb")) == NULL) {
+        perror("Failed to open file");
+        return -1;
+    }
+    
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INDEX_BIN_MAGIC, sizeof(header.magic));
+    header.version = INDEX_BIN_VERSION;
+    header.n_word = index->n_word;
+    header.frate = index->frate;
+    header.flags = INDEX_BIN_SORTED;
+    header.word_off = sizeof(bin_header_t);
+    
+    words = (bin_word_t*) calloc(index->n_word, sizeof(bin_word_t));
+    
+    /** the columns go first, the header and word table are filled in afterwards */
+    off = header.word_off + (uint64_t) index->n_word * sizeof(bin_word_t);
+    fseeko(fp, (off_t) off, SEEK_SET);
+    for (i = 0; i < index->n_word; i++) {
+        p = &(index->postings[i]);
+        if (p->unsorted) 
+            postings_sort_run(p, 0);
+        strncpy(words[i].word, vocab_word(index->vocab, i), WORD_MAX_LENGTH);
+        words[i].n_hit = p->n_hit;
+        words[i].off = off;
+        for (c = 0; c < N_COLUMN && p->n_hit > 0; c++) {
+            fwrite(p->col[c], sizeof(int32), p->n_hit, fp);
+        }
+        off += (uint64_t) N_COLUMN * p->n_hit * sizeof(int32);
+        header.n_hit += p->n_hit;
+    }
+    
+    header.utts_off = off;
+    header.utts_size = uttdict_write(index->utts, fp);
+    fseek(fp, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, fp);
+    fwrite(words, sizeof(bin_word_t), index->n_word, fp);
+    
+    free(words);
+    if (ferror(fp)) {
+        perror("Failed to write binary index");
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+    return 0;
+}
+
+inverted_index_t* inverted_index_read_bin(const char* filename)
+{
+    int fd, c;
+    uint32 i;
+    struct stat st;
+    void* map;
+    const bin_header_t* header;
+    const bin_word_t* words;
+    const char** word_names;
+    char* names;
+    uttdict_t* utts;
+    inverted_index_t* index;
+    postings_t* p;
+    
+    if ( (fd = open(filename, O_RDONLY)) < 0) {
+        perror("Failed to open file.");
+        return NULL;
+    }
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(bin_header_t)) {
+        perror("Not a binary index");
+        close(fd);
+        return NULL;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("Failed to map binary index");
+        return NULL;
+    }
+    
+    /** check the header before trusting any offset in it */
+    header = (const bin_header_t*) map;
+    if (strncmp(header->magic, INDEX_BIN_MAGIC, sizeof(header->magic)) != 0
+        || header->version != INDEX_BIN_VERSION
+        || header->frate <= 0
+        || header->word_off + (uint64_t) header->n_word * sizeof(bin_word_t) > (uint64_t) st.st_size
+        || header->utts_off + header->utts_size > (uint64_t) st.st_size) {
+        fprintf(stderr, "%s: bad binary index header or version\n", filename);
+        munmap(map, st.st_size);
+        return NULL;
+    }
+    utts = uttdict_read_mem((const char*) map + header->utts_off, header->utts_size);
+    if (!utts) {
+        fprintf(stderr, "%s: bad utterance dictionary\n", filename);
+        munmap(map, st.st_size);
+        return NULL;
+    }
+    words = (const bin_word_t*) ((const char*) map + header->word_off);
+    for (i = 0; i < header->n_word; i++) {
+        if (words[i].off % sizeof(int32) != 0
+            || words[i].off + (uint64_t) N_COLUMN * words[i].n_hit * sizeof(int32) > (uint64_t) st.st_size) {
+            fprintf(stderr, "%s: word %u is out of range\n", filename, i);
+            uttdict_free(utts);
+            munmap(map, st.st_size);
+            return NULL;
+        }
+    }
+    
+    /** the word table holds fixed-size, NUL-padded names */
+    word_names = (const char**) malloc((header->n_word + 1) * sizeof(char*));
+    names = (char*) calloc(header->n_word + 1, WORD_MAX_LENGTH + 1);
+    for (i = 0; i < header->n_word; i++) {
+        strncpy(names + i * (WORD_MAX_LENGTH + 1), words[i].word, WORD_MAX_LENGTH);
+        word_names[i] = names + i * (WORD_MAX_LENGTH + 1);
+    }
+    index = inverted_index_alloc(vocab_init(word_names, header->n_word), header->n_word);
+    free(word_names);
+    free(names);
+    uttdict_free(index->utts);
+    index->utts = utts;
+    index->frate = header->frate;
+    index->n_hit = header->n_hit;
+    
+    /** point the columns of every word into the mapping */
+    for (i = 0; i < header->n_word; i++) {
+        p = &(index->postings[i]);
+        p->n_hit = words[i].n_hit;
+        p->n_alloc = 0;
+        p->unsorted = !(header->flags & INDEX_BIN_SORTED);
+        for (c = 0; c < N_COLUMN; c++) {
+            p->col[c] = (int32*) ((char*) map + words[i].off) + c * p->n_hit;
+        }
+    }
+    index->map = map;
+    index->map_size = st.st_size;
+    return index;
+}
+
+/** A link that passed the posterior threshold, kept if it also fits under the cap */
+typedef struct candidate_s {
+    hit_t hit;
+    int32 post;
+    int32 seq;
+} candidate_t;
+
+/** Higher posterior first, then lattice order */
+static int candidate_cmp(const void* a, const void* b)
+{
+    const candidate_t* x = (const candidate_t*) a;
+    const candidate_t* y = (const candidate_t*) b;
+    if (x->post != y->post)
+        return (x->post > y->post) ? -1 : 1;
+    return x->seq - y->seq;
+}
+
+/** Word, then start frame, then lattice order */
+static int candidate_span_cmp(const void* a, const void* b)
+{
+    const candidate_t* x = (const candidate_t*) a;
+    const candidate_t* y = (const candidate_t*) b;
+    if (x->hit.wid != y->hit.wid)
+        return (x->hit.wid < y->hit.wid) ? -1 : 1;
+    if (x->hit.sf != y->hit.sf)
+        return (x->hit.sf < y->hit.sf) ? -1 : 1;
+    return x->seq - y->seq;
+}
+
+/**
+ * Merge the candidates of one word whose spans overlap into one hit over the union of the
+ * spans. The most likely of them gives the links and scores, its alpha is raised so that its
+ * posterior becomes the log-sum of the posteriors merged. Returns the number of candidates left.
+ */
+static int32 candidates_collapse(candidate_t* cand, int32 n_cand, logmath_t* lmath)
+{
+    int32 i, j, n = 0;
+    int32 sum, ef;
+    candidate_t* best;
+    
+    qsort(cand, n_cand, sizeof(candidate_t), candidate_span_cmp);
+    for (i = 0; i < n_cand; i = j) {
+        best = &(cand[i]);
+        sum = cand[i].post;
+        ef = cand[i].hit.ef;
+        for (j = i + 1; j < n_cand && cand[j].hit.wid == cand[i].hit.wid && cand[j].hit.sf <= ef; j++) {
+            sum = logmath_add(lmath, sum, cand[j].post);
+            if (cand[j].post > best->post)
+                best = &(cand[j]);
+            if (cand[j].hit.ef > ef)
+                ef = cand[j].hit.ef;
+        }
+        cand[n] = *best;
+        cand[n].hit.sf = cand[i].hit.sf;
+        cand[n].hit.ef = ef;
+        cand[n].hit.alpha += sum - cand[n].post;
+        cand[n].post = sum;
+        n++;
+    }
+    return n;
+}
+
+void inverted_index_set_collapse(inverted_index_t* index, int collapse)
+{
+    index->collapse = collapse;
+}
+
+void inverted_index_set_pruning(inverted_index_t* index, float64 min_posterior, float32 max_hits_per_sec)
+{
+    index->min_posterior = min_posterior;
+    index->max_hits_per_sec = max_hits_per_sec;
+}
+
+void inverted_index_get_stats(inverted_index_t* index, inverted_index_stats_t* stats)
+{
+    *stats = index->stats;
+}
+
+int lattice_get_links(ps_lattice_t* lat, vocab_t* vocab, lat_link_t** links)
 {
     int wid;
-    int32 norm;
     int16 sf, ef;
-    int32 nfrate;
-    int32 ascr, alpha, beta;
-    const char* word;
     const char* subseq_word;
     ps_latnode_iter_t* node_iter;
     ps_latlink_iter_t* link_iter;
     ps_latnode_t *d, *to;
     ps_latlink_t* link;
+    int n_link = 0, n_alloc = 0;
+    lat_link_t* l;
     
-    hit_t* hit;
-    
-    norm = ps_lattice_get_norm(lat);
-    
-    // Traverse all edges in the lattice to add new hits
+    *links = NULL;
+    // Traverse all edges in the lattice
     for (node_iter = ps_latnode_iter(lat); node_iter; node_iter = ps_latnode_iter_next(node_iter)) {
         d = ps_latnode_iter_node(node_iter); 
         if (!ps_latnode_reachable(d))
@@ -591,134 +1069,553 @@ void inverted_index_addhits(inverted_index_t* index, const char* uttid, ps_latti
                 continue; 
         
             /** Extract infomation from each link */
-    	    word = ps_latlink_word(lat, link);
-    	    wid = inverted_index_get_wid(index, word);
-    	    if (wid < 0) {
+    	    if ( (wid = vocab_wid(vocab, ps_latlink_word(lat, link))) < 0) {
     	        continue;
     	    }
-    	    
     	    subseq_word = ps_latnode_word(lat, ps_latlink_nodes(link, NULL));
     	    ef = ps_latlink_times(link, &sf); 
-    	    nfrate = ps_lattice_get_frate(lat);
-    	    ascr = (ps_latlink_get_ascr(link) << SENSCR_SHIFT) * ascale;
-    	    alpha = ps_latlink_get_alpha(link);
-    	    beta = ps_latlink_get_beta(link);
-    	    
-    	    //printf("%d: %s st:%.2f et:%.2f ascr:%d alpha:%d beta:%d\n", wid, word, (double) sf/nfrate, (double) ef/nfrate, ascr, alpha, beta);
-    	    // add a new hit 
-    	    hit = (hit_t*) malloc(sizeof(hit_t));
-    	    hit->uttid = (char*) malloc(MAX_LINE_LENGTH * sizeof(char));
-    	    memset(hit->uttid, 0, MAX_LINE_LENGTH * sizeof(char));
-    	    strncpy(hit->uttid, uttid, strlen(uttid));
     	    
-    	    hit->norm = norm;
-    	    
-    	    hit->wid = wid;
-            hit->word = (char*) malloc( (WORD_MAX_LENGTH+1) * sizeof(char));
-            memset(hit->word, 0, (WORD_MAX_LENGTH+1) * sizeof(char));
-            strncpy(hit->word, word, strlen(word));
-    	    
-    	    hit->subseq_word = (char*) malloc( (WORD_MAX_LENGTH+1) * sizeof(char));
-            memset(hit->subseq_word, 0, (WORD_MAX_LENGTH+1) * sizeof(char));
-            strncpy(hit->subseq_word, subseq_word, strlen(subseq_word));
-    	    
-    	    hit->from_id = ps_latnode_get_id(d);
-    	    
-    	    hit->to_id = ps_latnode_get_id(to);
-    	    
-    	    hit->start_time = (double) sf / nfrate;
-    	    hit->end_time = (double) ef / nfrate;
-    	    hit->alpha = alpha;
-    	    hit->beta = beta;
-    	    hit->ascr = ascr;
-    	    hit->next = NULL;
-    	    
-    	    if (index->first_hits[wid] == NULL) {
-    	        index->first_hits[wid] = hit;
-    	    } else {
-    	        index->last_hits[wid]->next = hit;
+    	    if (n_link == n_alloc) {
+    	        n_alloc = n_alloc ? n_alloc * 2 : 256;
+    	        *links = (lat_link_t*) realloc(*links, n_alloc * sizeof(lat_link_t));
     	    }
-    	    
-    	    index->last_hits[wid] = hit;
-    	    
+    	    l = &((*links)[n_link++]);
+    	    l->wid = wid;
+    	    l->next_wid = vocab_wid(vocab, subseq_word);
+    	    l->from_id = ps_latnode_get_id(d);
+    	    l->to_id = ps_latnode_get_id(to);
+    	    l->sf = sf;
+    	    l->ef = ef;
+    	    l->ascr = ps_latlink_get_ascr(link);
+    	    l->alpha = ps_latlink_get_alpha(link);
+    	    l->beta = ps_latlink_get_beta(link);
+    	    /** posterior of the link, alpha + beta - norm */
+    	    l->post = ps_latlink_prob(lat, link, NULL);
     	}
     }
+    return n_link;
+}
+
+void inverted_index_add_links(inverted_index_t* index, const char* uttid, const lat_link_t* links, int n_link,
+                              int32 norm, int32 nfrate, logmath_t* lmath, float32 ascale)
+{
+    int32 utt;
+    hit_t hit;
+    int32* first;
+    int i;
+    int32 min_post, max_ef = 0;
+    int32 n_cand = 0, n_keep;
+    candidate_t* cand = NULL;
+    
+    if (index->n_hit == 0) {
+        index->frate = nfrate;
+    } else if (nfrate != index->frate) {
+        fprintf(stderr, "%s: frame rate %d differs from the index (%d), skip it\n", uttid, nfrate, index->frate);
+        return;
+    }
+    min_post = (index->min_posterior > 0) 
+        ? logmath_log(lmath, index->min_posterior) : logmath_get_zero(lmath);
+    utt = uttdict_intern(index->utts, uttid);
+    /** where the hits of this lattice start in each posting list */
+    first = (int32*) malloc(index->n_word * sizeof(int32));
+    for (i = 0; i < index->n_word; i++) {
+        first[i] = index->postings[i].n_hit;
+    }
+    
+    cand = (candidate_t*) malloc((n_link + 1) * sizeof(candidate_t));
+    for (i = 0; i < n_link; i++) {
+        index->stats.n_link++;
+        if (links[i].ef > max_ef)
+            max_ef = links[i].ef;
+        if (links[i].post < min_post) {
+            index->stats.n_pruned_posterior++;
+            continue;
+        }
+        // add a new hit 
+        hit.utt = utt;
+        hit.norm = norm;
+        hit.wid = links[i].wid;
+        hit.next_wid = links[i].next_wid;
+        hit.from_id = links[i].from_id;
+        hit.to_id = links[i].to_id;
+        hit.sf = links[i].sf;
+        hit.ef = links[i].ef;
+        hit.alpha = links[i].alpha;
+        hit.beta = links[i].beta;
+        hit.ascr = (links[i].ascr << SENSCR_SHIFT) * ascale;
+        
+        cand[n_cand].hit = hit;
+        cand[n_cand].post = links[i].post;
+        cand[n_cand].seq = n_cand;
+        n_cand++;
+    }
+    
+    if (index->collapse && n_cand > 1) {
+        n_keep = candidates_collapse(cand, n_cand, lmath);
+        index->stats.n_collapsed += n_cand - n_keep;
+        n_cand = n_keep;
+    }
+    /** the cap keeps the most likely hits of the utterance */
+    n_keep = n_cand;
+    if (index->max_hits_per_sec > 0) {
+        n_keep = (int32) (index->max_hits_per_sec * (max_ef + 1) / nfrate + 0.5);
+        if (n_keep < 1)
+            n_keep = 1;
+        if (n_keep < n_cand) {
+            qsort(cand, n_cand, sizeof(candidate_t), candidate_cmp);
+            index->stats.n_pruned_cap += n_cand - n_keep;
+        } else {
+            n_keep = n_cand;
+        }
+    }
+    for (i = 0; i < n_keep; i++) {
+        postings_append(&(index->postings[cand[i].hit.wid]), &(cand[i].hit));
+    }
+    index->n_hit += n_keep;
+    index->stats.n_hit += n_keep;
+    free(cand);
+    
+    /** links come in lattice order, put the new hits of every word in (utterance, start frame) order */
+    for (i = 0; i < index->n_word; i++) {
+        if (index->postings[i].n_hit > first[i])
+            postings_sort_run(&(index->postings[i]), first[i]);
+    }
+    free(first);
+}
+
+void inverted_index_addhits(inverted_index_t* index, const char* uttid, ps_lattice_t* lat, float32 ascale)
+{
+    lat_link_t* links;
+    int n_link;
+    
+    n_link = lattice_get_links(lat, index->vocab, &links);
+    inverted_index_add_links(index, uttid, links, n_link, ps_lattice_get_norm(lat), 
+                             ps_lattice_get_frate(lat), ps_lattice_get_logmath(lat), ascale);
+    free(links);
 }  
 
 
+static void inverted_index_stats_add(inverted_index_stats_t* dst, const inverted_index_stats_t* src)
+{
+    dst->n_link += src->n_link;
+    dst->n_pruned_posterior += src->n_pruned_posterior;
+    dst->n_pruned_cap += src->n_pruned_cap;
+    dst->n_collapsed += src->n_collapsed;
+    dst->n_hit += src->n_hit;
+}
+
+int inverted_index_merge(inverted_index_t* dst, inverted_index_t* src)
+{
+    int i;
+    int32 j, first, n_hit = 0;
+    int32* utt_map = NULL;
+    hit_t hit;
+    postings_t* p;
+    
+    if (dst->n_word != src->n_word) {
+        perror("inverted_index_merge: different word lists");
+        return -1;
+    }
+    pthread_mutex_lock(&(dst->lock));
+    inverted_index_stats_add(&(dst->stats), &(src->stats));
+    if (src->n_hit == 0) {
+        pthread_mutex_unlock(&(dst->lock));
+        return 0;
+    }
+    /** **n_hit** is only counted after the stripes, a publication running now fixed the rate already */
+    if ((dst->n_hit > 0 || dst->frate_fixed) && src->frate != dst->frate) {
+        pthread_mutex_unlock(&(dst->lock));
+        perror("inverted_index_merge: different frame rates");
+        return -1;
+    }
+    dst->frate = src->frate;
+    dst->frate_fixed = 1;
+    pthread_mutex_unlock(&(dst->lock));
+    /** ordinals are translated unless both indexes share one dictionary */
+    if (src->utts != dst->utts) {
+        utt_map = uttdict_map(dst->utts, src->utts);
+    }
+    
+    for (i = 0; i < src->n_word; i++) {
+        if (src->postings[i].n_hit == 0)
+            continue;
+        pthread_mutex_lock(&(dst->stripes[i % N_STRIPE]));
+        p = &(dst->postings[i]);
+        first = p->n_hit;
+        postings_reserve(p, p->n_hit + src->postings[i].n_hit);
+        for (j = 0; j < src->postings[i].n_hit; j++) {
+            postings_get(&(src->postings[i]), i, j, &hit);
+            if (utt_map)
+                hit.utt = utt_map[hit.utt];
+            postings_append(p, &hit);
+        }
+        postings_sort_run(p, first);
+        pthread_mutex_unlock(&(dst->stripes[i % N_STRIPE]));
+        n_hit += src->postings[i].n_hit;
+    }
+    pthread_mutex_lock(&(dst->lock));
+    dst->n_hit += n_hit;
+    pthread_mutex_unlock(&(dst->lock));
+    free(utt_map);
+    return 0;
+}
+
+inverted_index_t* inverted_index_stage_init(inverted_index_t* index)
+{
+    inverted_index_t* stage = inverted_index_init_vocab(index->vocab);
+    inverted_index_set_pruning(stage, index->min_posterior, index->max_hits_per_sec);
+    inverted_index_set_collapse(stage, index->collapse);
+    return stage;
+}
+
+int inverted_index_publish(inverted_index_t* index, inverted_index_t* stage)
+{
+    int i;
+    if (inverted_index_merge(index, stage) < 0)
+        return -1;
+    /** empty the stage but keep its columns for the next batch */
+    for (i = 0; i < stage->n_word; i++) {
+        stage->postings[i].n_hit = 0;
+        stage->postings[i].unsorted = 0;
+    }
+    stage->n_hit = 0;
+    stage->frate_fixed = 0;
+    memset(&(stage->stats), 0, sizeof(inverted_index_stats_t));
+    uttdict_free(stage->utts);
+    stage->utts = uttdict_init();
+    return 0;
+}
+
 /**
- * function: inverted_index_search()
- * Return id of utterances in which all query terms are matched 
+ * merge_input_t
+ * One input of inverted_index_merge_files(): its tables, and a reader per column plus the
+ * row under them for the posting list being merged
+ */
+typedef struct merge_input_s {
+    FILE* fp;
+    bin_header_t header;
+    bin_word_t* words;
+    int32* utt_map;     /** ordinals of the input to those of the output */
+    int32 n_utt;
+    int bad;            /** set on an ordinal out of the dictionary */
+    bufio_t* cols[N_COLUMN];
+    int32 row[N_COLUMN];
+} merge_input_t;
+
+/** Nonzero if the row of input **a** goes before the row of input **b** */
+static int merge_input_less(merge_input_t* in, int a, int b)
+{
+    static const int key[] = {COL_UTT, COL_SF, COL_EF, COL_FROM_ID, COL_TO_ID};
+    int k;
+    for (k = 0; k < (int) (sizeof(key) / sizeof(key[0])); k++) {
+        if (in[a].row[key[k]] != in[b].row[key[k]])
+            return in[a].row[key[k]] < in[b].row[key[k]];
+    }
+    return a < b;
+}
+
+/** Load the next row of **in**, 0 at the end of its posting list */
+static int merge_input_next(merge_input_t* in)
+{
+    int c;
+    const int32* v;
+    for (c = 0; c < N_COLUMN; c++) {
+        if ( (v = (const int32*) bufio_read(in->cols[c])) == NULL)
+            return 0;
+        in->row[c] = *v;
+    }
+    if (in->row[COL_UTT] < 0 || in->row[COL_UTT] >= in->n_utt) {
+        in->bad = 1;
+        return 0;
+    }
+    in->row[COL_UTT] = in->utt_map[in->row[COL_UTT]];
+    return 1;
+}
+
+/** Restore the heap of inputs ordered by their rows, from slot **i** down */
+static void merge_heap_sift_down(merge_input_t* in, int* heap, int n, int i)
+{
+    int child, tmp;
+    while ( (child = 2 * i + 1) < n) {
+        if (child + 1 < n && merge_input_less(in, heap[child + 1], heap[child]))
+            child++;
+        if (!merge_input_less(in, heap[child], heap[i]))
+            break;
+        tmp = heap[i];
+        heap[i] = heap[child];
+        heap[child] = tmp;
+        i = child;
+    }
+}
+
+/** Open an input of inverted_index_merge_files() and check it against the first one */
+static int merge_input_open(merge_input_t* in, const char* filename, merge_input_t* first, uttdict_t* utts)
+{
+    int i;
+    uttdict_t* d;
+    
+    if ( (in->fp = fopen(filename, "rb")) == NULL) {
+        perror("Failed to open file");
+        return -1;
+    }
+    if (fread(&(in->header), sizeof(bin_header_t), 1, in->fp) != 1
+        || strncmp(in->header.magic, INDEX_BIN_MAGIC, sizeof(in->header.magic)) != 0
+        || in->header.version != INDEX_BIN_VERSION
+        || in->header.frate <= 0) {
+        fprintf(stderr, "%s: bad binary index header or version\n", filename);
+        return -1;
+    }
+    if (first && (in->header.n_word != first->header.n_word || in->header.frate != first->header.frate)) {
+        fprintf(stderr, "%s: different word list or frame rate\n", filename);
+        return -1;
+    }
+    in->words = (bin_word_t*) malloc((in->header.n_word + 1) * sizeof(bin_word_t));
+    if (fseeko(in->fp, (off_t) in->header.word_off, SEEK_SET) != 0
+        || fread(in->words, sizeof(bin_word_t), in->header.n_word, in->fp) != in->header.n_word) {
+        fprintf(stderr, "%s: truncated word table\n", filename);
+        return -1;
+    }
+    for (i = 0; first && i < (int) in->header.n_word; i++) {
+        if (strncmp(in->words[i].word, first->words[i].word, WORD_MAX_LENGTH) != 0) {
+            fprintf(stderr, "%s: different word list\n", filename);
+            return -1;
+        }
+    }
+    if (fseeko(in->fp, (off_t) in->header.utts_off, SEEK_SET) != 0
+        || (d = uttdict_read_fp(in->fp, in->header.utts_size)) == NULL) {
+        fprintf(stderr, "%s: bad utterance dictionary\n", filename);
+        return -1;
+    }
+    in->utt_map = uttdict_map(utts, d);
+    in->n_utt = uttdict_size(d);
+    uttdict_free(d);
+    return 0;
+}
+
+int inverted_index_merge_files(const char* const* inputs, int n_input, const char* output, size_t buf_size)
+{
+    int i, c, n, rv = -1;
+    int* heap = NULL;
+    size_t n_buf;
+    uint64_t off;
+    int32 u;
+    merge_input_t* in;
+    FILE* fp = NULL;
+    bufio_t* out[N_COLUMN] = {NULL,};
+    bin_header_t header;
+    bin_word_t* words = NULL;
+    uttdict_t* utts = uttdict_init();
+    
+    if (n_input <= 0) {
+        perror("inverted_index_merge_files: no input");
+        return -1;
+    }
+    in = (merge_input_t*) calloc(n_input, sizeof(merge_input_t));
+    memset(&header, 0, sizeof(header));
+    header.flags = INDEX_BIN_SORTED;
+    for (i = 0; i < n_input; i++) {
+        if (merge_input_open(&(in[i]), inputs[i], i ? &(in[0]) : NULL, utts) < 0)
+            goto exit;
+        /** the rows of an input stay in order only if its ordinals keep theirs */
+        for (u = 1; u < in[i].n_utt && in[i].utt_map[u] > in[i].utt_map[u-1]; u++)
+            ;
+        if (u < in[i].n_utt || !(in[i].header.flags & INDEX_BIN_SORTED))
+            header.flags = 0;
+    }
+    if ( (fp = fopen(output, "wb")) == NULL) {
+        perror("Failed to open file");
+        goto exit;
+    }
+    
+    /** one buffer per column of every input and of the output */
+    n_buf = buf_size / ((n_input + 1) * N_COLUMN * sizeof(int32));
+    if (n_buf < POSTINGS_INIT_SIZE)
+        n_buf = POSTINGS_INIT_SIZE;
+    for (c = 0; c < N_COLUMN; c++) {
+        out[c] = bufio_init(fp, sizeof(int32), n_buf);
+        for (i = 0; i < n_input; i++) {
+            in[i].cols[c] = bufio_init(in[i].fp, sizeof(int32), n_buf);
+        }
+    }
+    heap = (int*) malloc(n_input * sizeof(int));
+    
+    memcpy(header.magic, INDEX_BIN_MAGIC, sizeof(header.magic));
+    header.version = INDEX_BIN_VERSION;
+    header.n_word = in[0].header.n_word;
+    header.frate = in[0].header.frate;
+    header.word_off = sizeof(bin_header_t);
+    words = (bin_word_t*) calloc(header.n_word + 1, sizeof(bin_word_t));
+    off = header.word_off + (uint64_t) header.n_word * sizeof(bin_word_t);
+    
+    /** every output list is the k-way merge of the input lists, written column by column */
+    for (i = 0; i < (int) header.n_word; i++) {
+        memcpy(words[i].word, in[0].words[i].word, WORD_MAX_LENGTH + 1);
+        words[i].off = off;
+        for (n = 0; n < n_input; n++) {
+            words[i].n_hit += in[n].words[i].n_hit;
+        }
+        for (c = 0; c < N_COLUMN; c++) {
+            bufio_seek(out[c], (off_t) (off + (uint64_t) c * words[i].n_hit * sizeof(int32)), 0);
+        }
+        for (n = 0; n < n_input; n++) {
+            for (c = 0; c < N_COLUMN; c++) {
+                bufio_seek(in[n].cols[c], (off_t) (in[n].words[i].off + (uint64_t) c * in[n].words[i].n_hit * sizeof(int32)), 
+                        in[n].words[i].n_hit);
+            }
+        }
+        for (n = 0, c = 0; c < n_input; c++) {
+            if (merge_input_next(&(in[c])))
+                heap[n++] = c;
+        }
+        for (c = n / 2 - 1; c >= 0; c--) {
+            merge_heap_sift_down(in, heap, n, c);
+        }
+        while (n > 0) {
+            for (c = 0; c < N_COLUMN; c++) {
+                bufio_write(out[c], &(in[heap[0]].row[c]));
+            }
+            if (!merge_input_next(&(in[heap[0]])))
+                heap[0] = heap[--n];
+            merge_heap_sift_down(in, heap, n, 0);
+        }
+        for (c = 0; c < N_COLUMN; c++) {
+            if (bufio_flush(out[c]) < 0)
+                goto exit;
+        }
+        off += (uint64_t) N_COLUMN * words[i].n_hit * sizeof(int32);
+        header.n_hit += words[i].n_hit;
+    }
+    for (n = 0; n < n_input; n++) {
+        for (c = 0; c < N_COLUMN && !bufio_error(in[n].cols[c]); c++)
+            ;
+        if (c < N_COLUMN || in[n].bad) {
+            fprintf(stderr, "%s: truncated or corrupted posting list\n", inputs[n]);
+            goto exit;
+        }
+    }
+    
+    header.utts_off = off;
+    fseeko(fp, (off_t) off, SEEK_SET);
+    header.utts_size = uttdict_write(utts, fp);
+    fseek(fp, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, fp);
+    fwrite(words, sizeof(bin_word_t), header.n_word, fp);
+    if (ferror(fp)) {
+        perror("Failed to write binary index");
+        goto exit;
+    }
+    rv = 0;
+    
+exit:
+    for (i = 0; i < n_input; i++) {
+        for (c = 0; c < N_COLUMN; c++) {
+            bufio_free(in[i].cols[c]);
+        }
+        if (in[i].fp)
+            fclose(in[i].fp);
+        free(in[i].words);
+        free(in[i].utt_map);
+    }
+    for (c = 0; c < N_COLUMN; c++) {
+        bufio_free(out[c]);
+    }
+    if (fp && fclose(fp) != 0)
+        rv = -1;
+    free(in);
+    free(heap);
+    free(words);
+    uttdict_free(utts);
+    return rv;
+}
+
+/**
+ * function: inverted_index_search_cb()
+ * Find the utterances in which all query terms are matched and hand the spans to **cb**
  */ 
-void inverted_index_search(inverted_index_t* index, ngram_model_t* lm, float32 ascale, char** terms, int n_term, result_list_t** rl)
+int inverted_index_search_cb(inverted_index_t* index, ngram_model_t* lm, float32 ascale, char** terms, int n_term, int n_best, result_cb_t cb, void* data)
 {
     if (!index) {
         perror("Index not found");
-        return;
+        return -1;
     }
     
     if (!lm) {
         perror("lm not found");
-        return;
+        return -1;
     }
 
-    if (!terms) {
+    if (!terms || n_term <= 0) {
         perror("no query terms");
-        return;
+        return -1;
     }
     int i, k;
-    int rv;
+    int n_result = 0;
+    result_t r;
     int wid;
-    hit_t* hit;
+    int32 j, lo, interval;
+    const int32 *utt, *sf;
+    hit_t hit;
+    postings_t* postings;
     partial_path_t *p, *q;
     path_queue_t** queues;
+    arena_t* arena;
     
-    *rl = NULL;
-    queues =  (path_queue_t**) malloc( n_term * sizeof(path_queue_t*) );
+    interval = (int32) (INTERVAL * index->frate + 0.5);
+    inverted_index_set_lm(index, lm);
+    /** everything the query allocates is dropped at once when it returns */
+    arena = arena_thread_acquire();
+    queues =  (path_queue_t**) arena_alloc(arena, n_term * sizeof(path_queue_t*) );
     for (i = 0; i < n_term; i++) {
-        queues[i] = path_queue_init();
+        queues[i] = path_queue_init(arena);
     }
     /** Seach candidate partial pathes which match all query terms */
     for (k = 0; k < n_term; k++) {
         if ( (wid = inverted_index_get_wid(index, terms[k])) != -1) {
-            hit = index->first_hits[wid];
-            if (!hit) {
+            postings = &(index->postings[wid]);
+            if (postings->n_hit == 0) {
                 perror("No hits on current query term");
                 break;
             }
-            while (hit) {
-                if (k == 0) { /** first query term */
-                    q = partial_path_init();  
-                    rv = partial_path_extend(q, hit);
-                    if ( 0 != rv ) {
+            if (k > 0 && !queues[k-1]->head) {
+                fprintf(stderr, "No hits on previous term k:%d\n", k);
+                goto exit;
+            }
+            if (postings->unsorted) 
+                postings_sort_run(postings, 0);
+            if (k == 0) { /** first query term */
+                for (j = 0; j < postings->n_hit; j++) {
+                    postings_get(postings, wid, j, &hit);
+                    if ( (q = partial_path_extend(NULL, &hit, arena)) == NULL) {
                         perror("Error when adding hit to path, skip it");
-                        partial_path_free(q);
                         continue;
                     }
-					q->post = partial_path_get_posterior(q, lm, ascale);
+					q->post = partial_path_get_posterior(q, index, ascale);
                     path_queue_add(queues[k], q);              
-                                                          
-                } else {
-                    if (!queues[k-1]->head) {
-                        fprintf(stderr, "No hits on previous term k:%d\n", k);
-                        goto exit;
-                    }
-                    for (p = queues[k-1]->head; p; p = p->next) {
-                        if ( (strncmp(p->first_term->uttid, hit->uttid, strlen(hit->uttid)) == 0)
-                             && ( ( (p->last_term->end_time) <= hit->start_time) && hit->start_time <= (p->last_term->end_time + INTERVAL)) ) {
-                               q = partial_path_copy(p);
-                               if ( 0 != partial_path_extend(q, hit) ) {
-                                   perror("Error when adding hit to path, skip it");
-                                   partial_path_free(q);
-                                   continue;
-                               }
-							   q->post = partial_path_get_posterior(q, lm, ascale);
-                               path_queue_add(queues[k], q);  
+                }
+            } else {
+                /**
+                 * Paths of the previous term come grouped by utterance in increasing
+                 * order, so the start of the utterance's postings only moves forward;
+                 * inside it the hits starting within INTERVAL are found by galloping.
+                 */
+                utt = postings->col[COL_UTT];
+                sf = postings->col[COL_SF];
+                lo = 0;
+                for (p = queues[k-1]->head; p; p = p->next) {
+                    lo = postings_lower_bound(postings, lo, p->first->term.utt, 0);
+                    j = postings_lower_bound(postings, lo, p->first->term.utt, p->term.ef);
+                    for (; j < postings->n_hit && utt[j] == p->first->term.utt 
+                            && sf[j] <= p->term.ef + interval; j++) {
+                        postings_get(postings, wid, j, &hit);
+                        if ( (q = partial_path_extend(p, &hit, arena)) == NULL) {
+                            perror("Error when adding hit to path, skip it");
+                            continue;
                         }
-                    }                
-                }               
-                hit = hit->next;
-            }
+						q->post = partial_path_get_posterior(q, index, ascale);
+                        path_queue_add(queues[k], q);  
+                    }
+                }                
+            }               
         //path_queue_print(queues[k]);
         } else {
             perror("Query term not found inside the index");
@@ -730,18 +1627,38 @@ void inverted_index_search(inverted_index_t* index, ngram_model_t* lm, float32 a
         k = n_term - 1;
         if (queues[k]->n_path > 0) { /** candidate path exists*/
             /** Compare similiarity between query terms and utterances */
-            int32 norm;
-            printf("#result: %d\n", queues[k]->n_path);
-			path_queue_sort(&(queues[k]));
-            path_queue_print(queues[k]);            
+            partial_path_t** top;
+            int n_top = path_queue_top(queues[k], n_best, &top, arena);
+            for (i = 0; i < n_top; i++) {
+                r.utt = top[i]->first->term.utt;
+                /** the file is not scanned on load, a corrupt ordinal is caught here */
+                if ( (r.uttid = uttdict_str(index->utts, r.utt)) == NULL)
+                    continue;
+                r.start = top[i]->first->term.sf;
+                r.end = top[i]->term.ef;
+                r.frate = index->frate;
+                r.score = top[i]->post;
+                r.next = NULL;
+                n_result++;
+                if (cb(&r, data))
+                    break;
+            }
         }
     }
     
   
 exit:      
-    for (i = 0; i < n_term; i++) {
-        path_queue_free(queues[i]);
-    }
-    free(queues);   
+    arena_thread_release(arena);
+    return n_result;
 }
 
+int inverted_index_search(inverted_index_t* index, ngram_model_t* lm, float32 ascale, char** terms, int n_term, int n_best, result_list_t** rl)
+{
+    int n_result;
+    *rl = result_list_init();
+    if ( (n_result = inverted_index_search_cb(index, lm, ascale, terms, n_term, n_best, result_list_add, *rl)) < 0) {
+        result_list_free(*rl);
+        *rl = NULL;
+    }
+    return n_result;
+}
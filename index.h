@@ -3,6 +3,9 @@
 #define __INDEX_H__
 
 #include "pocketsphinx.h"
+#include "uttdict.h"
+#include "vocab.h"
+#include "result.h"
 
 /** 
  * hit_t
@@ -15,9 +18,30 @@ typedef struct hit_s hit_t;
 typedef struct inverted_index_s inverted_index_t;
 
 /**
- * result_list_t
+ * lat_link_t
+ * A link of a lattice as the index takes it, before any pruning. Words are wids of the
+ * vocabulary the links were extracted with, -1 for a following word outside it.
  */
-typedef struct result_list_s result_list_t;
+typedef struct lat_link_s {
+    int32 wid, next_wid;
+    int32 from_id, to_id;   /** lattice node ids */
+    int32 sf, ef;
+    int32 ascr;             /** acoustic score, not scaled */
+    int32 alpha, beta;
+    int32 post;             /** posterior, alpha + beta - norm */
+} lat_link_t;
+
+/**
+ * inverted_index_stats_t
+ * What inverted_index_addhits() did with the links of the lattices
+ */
+typedef struct inverted_index_stats_s {
+    long n_link;                /** links of an indexed word, reachable and with a valid score */
+    long n_pruned_posterior;    /** left out under the posterior threshold */
+    long n_pruned_cap;          /** left out by the cap on hits per second */
+    long n_collapsed;           /** merged into an overlapping hit of the same word */
+    long n_hit;                 /** indexed */
+} inverted_index_stats_t;
 
 /**
  * function: inverted_index_init();
@@ -25,6 +49,12 @@ typedef struct result_list_s result_list_t;
  */
 inverted_index_t* inverted_index_init(const char* filename);
 
+/**
+ * function: inverted_index_init_vocab();
+ * Create an empty inverted_index over an existing vocabulary, e.g. one shared with a dual-clue index.
+ */
+inverted_index_t* inverted_index_init_vocab(vocab_t* vocab);
+
 /**
  * function: inverted_index_free()
  * free the memory of a inverted_index
@@ -39,27 +69,163 @@ inverted_index_t* inverted_index_read(const char* filename);
  
 /**
  * function: inverted_index_write()
- * Save a inverted_index to a file
+ * Save a inverted_index to a text file, mainly for debugging
  */
 int inverted_index_write(inverted_index_t* index, const char* filename);
 
+/**
+ * function: inverted_index_read_bin()
+ * Map a binary inverted_index written by inverted_index_write_bin(); the posting columns
+ * are served in place from the mapping, so loading does not depend on the number of hits.
+ * Utterance ordinals are not checked on load, search skips spans outside the dictionary.
+ */
+inverted_index_t* inverted_index_read_bin(const char* filename);
+
+/**
+ * function: inverted_index_write_bin()
+ * Save a inverted_index to a file in the versioned binary format
+ */
+int inverted_index_write_bin(inverted_index_t* index, const char* filename);
+
+/**
+ * function: inverted_index_get_uttdict()
+ * return the utterance dictionary the hits of **index** refer to
+ */
+uttdict_t* inverted_index_get_uttdict(inverted_index_t* index);
+
+/**
+ * function: inverted_index_set_uttdict()
+ * share **utts** with another index; only allowed while **index** holds no hits
+ */
+int inverted_index_set_uttdict(inverted_index_t* index, uttdict_t* utts);
+
 /**
  * function: inverted_index_get_wid()
  * return the index number of **word** in the word_list
  */
 int inverted_index_get_wid(inverted_index_t* index, const char* word);
 
+/**
+ * function: inverted_index_get_vocab()
+ * return the vocabulary of **index**
+ */
+vocab_t* inverted_index_get_vocab(inverted_index_t* index);
+
+/**
+ * function: inverted_index_set_lm()
+ * Precompute the bigram scores between all words of the vocabulary under **lm**;
+ * the search does it on its own when called with another lm
+ */
+void inverted_index_set_lm(inverted_index_t* index, ngram_model_t* lm);
+
+/**
+ * function: inverted_index_share_lm()
+ * Use the bigram table of **from** instead of building one, e.g. for many small indexes
+ * searched with the same lm. Both must have the same word list. Returns 0, -1 on error.
+ */
+int inverted_index_share_lm(inverted_index_t* index, inverted_index_t* from);
+
+/**
+ * function: inverted_index_freeze()
+ * Sort every posting list and build the bigram table for **lm**. Searches with **lm** then
+ * only read the index, so several of them may run at once as long as nothing is added.
+ */
+void inverted_index_freeze(inverted_index_t* index, ngram_model_t* lm);
+
+/**
+ * function: inverted_index_set_pruning()
+ * Leave out of the lattices added from now on the links whose posterior probability is below
+ * **min_posterior** (0 keeps them all), then keep at most **max_hits_per_sec** hits per second
+ * of audio, the most likely ones (0 for no cap). Staging indexes take the settings of their index.
+ */
+void inverted_index_set_pruning(inverted_index_t* index, float64 min_posterior, float32 max_hits_per_sec);
+
+/**
+ * function: inverted_index_set_collapse()
+ * If **collapse** is nonzero, the hits of one word whose spans overlap within an utterance are
+ * added as a single hit spanning them all, with the log-sum of their posteriors. This is done
+ * after the posterior threshold and before the cap of inverted_index_set_pruning().
+ */
+void inverted_index_set_collapse(inverted_index_t* index, int collapse);
+
+/**
+ * function: inverted_index_get_stats()
+ * Copy the counts of links indexed and pruned by inverted_index_addhits(), including those of
+ * the indexes merged or published into **index**
+ */
+void inverted_index_get_stats(inverted_index_t* index, inverted_index_stats_t* stats);
+
 /**
  * function: inverted_index_addhits()
  * Add new hits from a lattice
  */
 void inverted_index_addhits(inverted_index_t* index, const char* uttid, ps_lattice_t* lat, float32 ascale);
 
+/**
+ * function: lattice_get_links()
+ * Collect into **links** the reachable links of **lat** whose word is in **vocab**, in lattice
+ * order. **links** is to be freed by the caller. Returns the number of links.
+ */
+int lattice_get_links(ps_lattice_t* lat, vocab_t* vocab, lat_link_t** links);
+
+/**
+ * function: inverted_index_add_links()
+ * Same as inverted_index_addhits() over links taken from a lattice beforehand, with its
+ * normalizer **norm**, frame rate **frate** and the **lmath** its scores are in. The wids must
+ * be those of the index's vocabulary.
+ */
+void inverted_index_add_links(inverted_index_t* index, const char* uttid, const lat_link_t* links, int n_link,
+                              int32 norm, int32 frate, logmath_t* lmath, float32 ascale);
+
+
+/**
+ * function: inverted_index_merge()
+ * Append the hits of **src** to **dst**; both must use the same word list. Utterance
+ * ordinals are translated if the indexes do not share a dictionary. Returns 0, -1 on error.
+ * Several merges into the same **dst** may run at once, they lock one stripe of words at a time.
+ */
+int inverted_index_merge(inverted_index_t* dst, inverted_index_t* src);
+
+/**
+ * function: inverted_index_merge_files()
+ * Merge the binary indexes **inputs**, written by inverted_index_write_bin() over the same word
+ * list, into the binary index **output**. Posting lists are streamed word by word through a
+ * k-way merge, so memory is bounded by about **buf_size** bytes plus the utterance dictionaries,
+ * whatever the number of hits. Returns 0, -1 on error.
+ */
+int inverted_index_merge_files(const char* const* inputs, int n_input, const char* output, size_t buf_size);
+
+/**
+ * function: inverted_index_stage_init()
+ * Create a private staging index for one thread: it shares the word list of **index** and
+ * has its own utterance dictionary, so inverted_index_addhits() on it needs no locking.
+ */
+inverted_index_t* inverted_index_stage_init(inverted_index_t* index);
+
+/**
+ * function: inverted_index_publish()
+ * Move the hits of **stage** to **index** and empty the stage. Threads may publish to the same
+ * index at once; postings end in (utterance, start frame, end frame, node ids) order, so the
+ * content does not depend on the order of publication. Utterance ordinals do, unless the ids
+ * were interned in **index** beforehand. Not to be mixed with searches or writes of **index**.
+ * Returns 0, -1 on error.
+ */
+int inverted_index_publish(inverted_index_t* index, inverted_index_t* stage);
+
+/**
+ * function: inverted_index_search_cb()
+ * Hand the **n_best** best spans matching all query terms to **cb**, best first, every span
+ * if **n_best** <= 0. The spans are ranked once the whole query is matched, so **cb** returning
+ * nonzero only stops delivering results, it does not cut the search short.
+ * Returns the number of results delivered, -1 on error.
+ */ 
+int inverted_index_search_cb(inverted_index_t* index, ngram_model_t* lm, float32 ascale, char** terms, int n_term, int n_best, result_cb_t cb, void* data);
 
 /**
  * function: inverted_index_search()
- * 
+ * Collect the **n_best** best spans matching all query terms in a new list **rl**,
+ * to be freed with result_list_free(). Returns the number of results, -1 on error.
  */ 
-void inverted_index_search(inverted_index_t* index, ngram_model_t* lm, float32 ascale, char** terms, int n_term, result_list_t** rl);
+int inverted_index_search(inverted_index_t* index, ngram_model_t* lm, float32 ascale, char** terms, int n_term, int n_best, result_list_t** rl);
 
 #endif
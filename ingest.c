@@ -0,0 +1,209 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "ingest.h"
+#include "artifact.h"
+
+#define MAX_LINE_LENGTH 1024
+
+/**
+ * ingest_t
+ * Work shared by the workers: the manifest entries are handed out through **next**.
+ */
+typedef struct ingest_s {
+    int n_utt;
+    char** uttids;
+    char** paths;
+    int next;           /** next manifest entry to decode, taken with an atomic add */
+    float32 ascale;
+    sim_table_t* sim;   /** word similarities for sausage construction, read-only */
+    sausage_builder_t builder;  /** the choice of the dual-clue index, the default without one */
+    artifact_writer_t* archive;
+} ingest_t;
+
+/**
+ * worker_t
+ * A decoder and the staging indexes it fills, published to the targets after every file.
+ */
+typedef struct worker_s {
+    ingest_t* ingest;
+    ps_decoder_t* ps;
+    inverted_index_t* index;
+    dualclue_index_t* dc_index;
+    inverted_index_t* stage;
+    dualclue_index_t* dc_stage;
+    int n_done;
+    pthread_t thread;
+} worker_t;
+
+/** Read the manifest, returns the number of entries, -1 on error */
+static int ingest_read_manifest(ingest_t* ing, const char* manifest)
+{
+    FILE* fp;
+    char line[MAX_LINE_LENGTH] = {'\0',};
+    char uttid[MAX_LINE_LENGTH], path[MAX_LINE_LENGTH];
+    int n_alloc = 0, k;
+    
+    if ( (fp = fopen(manifest, "r")) == NULL) {
+        perror("Failed to open manifest");
+        return -1;
+    }
+    while (fgets(line, MAX_LINE_LENGTH, fp) != NULL) {
+        if ( (k = sscanf(line, "%s %s", uttid, path)) < 1 || uttid[0] == '#')
+            continue;
+        if (k == 1) 
+            strcpy(path, uttid);
+        if (ing->n_utt == n_alloc) {
+            n_alloc = n_alloc ? n_alloc * 2 : 256;
+            ing->uttids = (char**) realloc(ing->uttids, n_alloc * sizeof(char*));
+            ing->paths = (char**) realloc(ing->paths, n_alloc * sizeof(char*));
+        }
+        ing->uttids[ing->n_utt] = strdup(uttid);
+        ing->paths[ing->n_utt] = strdup(path);
+        ing->n_utt++;
+    }
+    fclose(fp);
+    return ing->n_utt;
+}
+
+static void* ingest_worker(void* arg)
+{
+    worker_t* w = (worker_t*) arg;
+    ingest_t* ing = w->ingest;
+    int i;
+    FILE* fh;
+    ps_lattice_t* dag;
+    sausage_t* s;
+    lite_sausage_t* lite_s;
+    lat_link_t* links;
+    int n_link;
+    
+    while ( (i = __sync_fetch_and_add(&(ing->next), 1)) < ing->n_utt) {
+        if ( (fh = fopen(ing->paths[i], "rb")) == NULL) {
+            fprintf(stderr, "%s: failed to open audio file\n", ing->paths[i]);
+            continue;
+        }
+        if (ps_decode_raw(w->ps, fh, ing->uttids[i], -1) < 0
+            || (dag = ps_get_lattice(w->ps)) == NULL) {
+            fprintf(stderr, "%s: no lattice\n", ing->paths[i]);
+            fclose(fh);
+            continue;
+        }
+        fclose(fh);
+        
+        links = NULL;
+        n_link = 0;
+        if (ing->archive) 
+            n_link = lattice_get_links(dag, artifact_writer_get_vocab(ing->archive), &links);
+        if (w->stage) {
+            /** the links of the archive serve the lattice index too if they share the words */
+            if (ing->archive && artifact_writer_get_vocab(ing->archive) == inverted_index_get_vocab(w->stage)) 
+                inverted_index_add_links(w->stage, ing->uttids[i], links, n_link, ps_lattice_get_norm(dag),
+                                         ps_lattice_get_frate(dag), ps_lattice_get_logmath(dag), 1.0/ing->ascale);
+            else
+                inverted_index_addhits(w->stage, ing->uttids[i], dag, 1.0/ing->ascale);
+            inverted_index_publish(w->index, w->stage);
+        }
+        if (w->dc_stage || ing->archive) {
+            s = sausage_build(dag, ing->builder, ing->sim);
+            lite_s = sausage_simplify(s, dag, w->dc_stage 
+                ? dualclue_index_get_vocab(w->dc_stage) : artifact_writer_get_vocab(ing->archive));
+            if (w->dc_stage) {
+                dualclue_index_addhit(w->dc_stage, ing->uttids[i], lite_s);
+                dualclue_index_publish(w->dc_index, w->dc_stage);
+            }
+            if (ing->archive) 
+                artifact_write(ing->archive, ing->uttids[i], ps_lattice_get_frate(dag), ps_lattice_get_norm(dag),
+                               links, n_link, lite_s);
+            lite_sausage_free(lite_s);
+            sausage_free(s);
+        }
+        free(links);
+        w->n_done++;
+    }
+    return NULL;
+}
+
+int ingest_manifest(cmd_ln_t* config, const char* manifest, int n_worker,
+                    inverted_index_t* index, dualclue_index_t* dc_index, artifact_writer_t* archive)
+{
+    ingest_t ing;
+    worker_t* workers;
+    uttdict_t *utts = NULL, *dc_utts = NULL;
+    int i, n_started, n_done = 0;
+    
+    if (!config || n_worker <= 0 || (!index && !dc_index && !archive)) {
+        perror("ingest_manifest: bad arguments");
+        return -1;
+    }
+    memset(&ing, 0, sizeof(ing));
+    if (ingest_read_manifest(&ing, manifest) < 0) 
+        return -1;
+    ing.ascale = cmd_ln_float32_r(config, "-ascale");
+    ing.archive = archive;
+    
+    /**
+     * Intern every utterance id up front, in manifest order, so that the ordinals do not
+     * depend on which worker publishes first.
+     */
+    if (index) {
+        utts = inverted_index_get_uttdict(index);
+        for (i = 0; i < ing.n_utt; i++) 
+            uttdict_intern(utts, ing.uttids[i]);
+    }
+    if (dc_index) {
+        dc_utts = dualclue_index_get_uttdict(dc_index);
+        for (i = 0; i < ing.n_utt; i++) 
+            uttdict_intern(dc_utts, ing.uttids[i]);
+    }
+    ing.builder = dc_index ? dualclue_index_get_builder(dc_index) : SAUSAGE_BUILDER_IMPROVED;
+    if ((dc_index || archive) && ing.builder == SAUSAGE_BUILDER_IMPROVED) 
+        ing.sim = sim_table_init(dc_index ? dualclue_index_get_vocab(dc_index) : artifact_writer_get_vocab(archive));
+    
+    /** decoders are created here, one at a time, since ps_init() may touch the shared config */
+    workers = (worker_t*) calloc(n_worker, sizeof(worker_t));
+    for (n_started = 0; n_started < n_worker; n_started++) {
+        worker_t* w = &(workers[n_started]);
+        w->ingest = &ing;
+        if ( (w->ps = ps_init(config)) == NULL) {
+            perror("ingest_manifest: failed to initialize a decoder");
+            break;
+        }
+        w->index = index;
+        w->dc_index = dc_index;
+        if (index) 
+            w->stage = inverted_index_stage_init(index);
+        if (dc_index) 
+            w->dc_stage = dualclue_index_stage_init(dc_index);
+        if (pthread_create(&(w->thread), NULL, ingest_worker, w) != 0) {
+            perror("ingest_manifest: failed to start a worker");
+            ps_free(w->ps);
+            if (w->stage)
+                inverted_index_free(w->stage);
+            dualclue_index_free(w->dc_stage);
+            break;
+        }
+    }
+    
+    for (i = 0; i < n_started; i++) {
+        worker_t* w = &(workers[i]);
+        pthread_join(w->thread, NULL);
+        if (w->stage) 
+            inverted_index_free(w->stage);
+        if (w->dc_stage) 
+            dualclue_index_free(w->dc_stage);
+        ps_free(w->ps);
+        n_done += w->n_done;
+    }
+    
+    free(workers);
+    sim_table_free(ing.sim);
+    for (i = 0; i < ing.n_utt; i++) {
+        free(ing.uttids[i]);
+        free(ing.paths[i]);
+    }
+    free(ing.uttids);
+    free(ing.paths);
+    return n_started > 0 ? n_done : -1;
+}
@@ -0,0 +1,29 @@
+/*************************************************************************************************
+ * ingest.h
+ * Parallel indexing of many recordings. A manifest lists the audio files; a pool of workers,
+ * each with its own decoder, turns them into lattice hits and simplified sausages stored in
+ * private staging indexes, which are published to the target indexes after every file.
+ *
+ *************************************************************************************************/
+#ifndef __INGEST_H__
+#define __INGEST_H__
+
+#include "pocketsphinx.h"
+#include "index.h"
+#include "sausage.h"
+#include "artifact.h"
+
+/**
+ * function: ingest_manifest()
+ * Decode the raw audio files of **manifest**, one "uttid path" (or just "path") per line, with
+ * **n_worker** threads, each running a decoder built from **config**. Lattice hits are added to
+ * **index** and simplified sausages to **dc_index**, either may be NULL. If **archive** is not
+ * NULL, the links and sausage of every utterance are also written to it, so that the indexes
+ * can be rebuilt later with artifact_reindex(). Utterance ordinals follow the manifest order
+ * whatever the number of workers.
+ * Returns the number of files indexed, -1 on error.
+ */
+int ingest_manifest(cmd_ln_t* config, const char* manifest, int n_worker,
+                    inverted_index_t* index, dualclue_index_t* dc_index, artifact_writer_t* archive);
+
+#endif
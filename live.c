@@ -0,0 +1,697 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "live.h"
+
+#define MAX_PATH_LENGTH 1024
+#define MAX_LINE_LENGTH 256
+#define COMPACT_FANOUT 4    /** segments of one level merged into one of the next level */
+#define COMPACT_BUF_SIZE (4 << 20)  /** bytes of buffers a compaction on disk streams through */
+#define MANIFEST_NAME "MANIFEST"
+
+/**
+ * segment_t
+ * Indexes that no longer change, shared by every version listing them
+ */
+typedef struct segment_s {
+    int refcount;
+    int id;             /** files <id>.idx and <id>.dc of an on-disk live index */
+    int level;          /** 0 when published, one more than its sources when compacted */
+    inverted_index_t* index;
+    dualclue_index_t* dc_index;
+} segment_t;
+
+struct live_snapshot_s {
+    int refcount;       /** the live index holds one while the version is current */
+    int version;
+    int n_seg;
+    segment_t** segs;
+    ngram_model_t* lm;
+};
+
+struct live_index_s {
+    vocab_t* vocab;
+    ngram_model_t* lm;
+    inverted_index_t* lm_index;     /** empty index holding the bigram table shared by all segments */
+    char* dir;                      /** segment files and MANIFEST, NULL for an index in memory */
+    int next_id;
+    live_snapshot_t* current;
+    pthread_mutex_t lock;           /** guards **current**, only held to copy it and take a reference */
+    pthread_mutex_t publish_lock;   /** one change of version at a time, and of the MANIFEST */
+    
+    pthread_mutex_t compact_lock;   /** one compaction at a time */
+    pthread_mutex_t wake_lock;      /** guards **pending** and **stop** */
+    pthread_cond_t wake;            /** signaled by publications and by live_index_free() */
+    int pending;                    /** publications the compactor has not looked at */
+    int stop;
+    int compactor_running;
+    pthread_t compactor;
+};
+
+/** Results of all segments, ranked once every segment is searched */
+typedef struct ranked_s {
+    result_t r;
+    int seq;            /** order of arrival, breaks ties between equal scores */
+} ranked_t;
+
+typedef struct ranking_s {
+    int n;
+    int n_alloc;
+    ranked_t* items;
+} ranking_t;
+
+static void segment_release(segment_t* seg)
+{
+    if (__sync_sub_and_fetch(&(seg->refcount), 1) > 0)
+        return;
+    if (seg->index)
+        inverted_index_free(seg->index);
+    dualclue_index_free(seg->dc_index);
+    free(seg);
+}
+
+/** Path of a file of the live index directory */
+static void live_path(live_index_t* live, char* path, const char* name, int id, const char* ext)
+{
+    if (name)
+        snprintf(path, MAX_PATH_LENGTH, "%s/%s", live->dir, name);
+    else
+        snprintf(path, MAX_PATH_LENGTH, "%s/%06d%s", live->dir, id, ext);
+}
+
+/** Flush a file or a directory to disk, returns 0, -1 on error */
+static int fsync_path(const char* path)
+{
+    int fd, rv;
+    if ( (fd = open(path, O_RDONLY)) < 0)
+        return -1;
+    rv = fsync(fd);
+    close(fd);
+    return rv;
+}
+
+/** Everything a search would do lazily is done before the segment is visible to readers */
+static segment_t* segment_init(live_index_t* live, int id, int level, inverted_index_t* index, dualclue_index_t* dc_index)
+{
+    segment_t* seg = (segment_t*) malloc(sizeof(segment_t));
+    seg->refcount = 1;
+    seg->id = id;
+    seg->level = level;
+    seg->index = index;
+    seg->dc_index = dc_index;
+    if (index) {
+        inverted_index_share_lm(index, live->lm_index);
+        inverted_index_freeze(index, live->lm);
+    }
+    if (dc_index)
+        dualclue_index_freeze(dc_index);
+    return seg;
+}
+
+/**
+ * Write the indexes of a new segment and map them back, so that the heap copy is dropped.
+ * Only the new data is written, and it is on disk before any MANIFEST lists it. Returns 0,
+ * -1 on error.
+ */
+static int segment_write(live_index_t* live, int id, inverted_index_t** index, dualclue_index_t** dc_index)
+{
+    char path[MAX_PATH_LENGTH];
+    if (*index) {
+        live_path(live, path, NULL, id, ".idx");
+        if (inverted_index_write_bin(*index, path) < 0 || fsync_path(path) < 0)
+            return -1;
+        inverted_index_free(*index);
+        if ( (*index = inverted_index_read_bin(path)) == NULL)
+            return -1;
+    }
+    if (*dc_index) {
+        live_path(live, path, NULL, id, ".dc");
+        if (dualclue_index_write_bin(*dc_index, path) < 0 || fsync_path(path) < 0)
+            return -1;
+        dualclue_index_free(*dc_index);
+        if ( (*dc_index = dualclue_index_read_bin(path)) == NULL)
+            return -1;
+    }
+    return 0;
+}
+
+/**
+ * Merge the files of the segments of **run** into those of segment **id** and map them back.
+ * The hits are streamed from file to file, so memory does not grow with the level. Returns 0,
+ * -1 on error.
+ */
+static int segment_merge_files(live_index_t* live, int id, segment_t** run, inverted_index_t** index, dualclue_index_t** dc_index)
+{
+    char path[MAX_PATH_LENGTH];
+    char names[COMPACT_FANOUT][MAX_PATH_LENGTH];
+    const char* inputs[COMPACT_FANOUT];
+    int i, n;
+    
+    for (i = n = 0; i < COMPACT_FANOUT; i++) {
+        if (run[i]->index) {
+            live_path(live, names[n], NULL, run[i]->id, ".idx");
+            inputs[n] = names[n];
+            n++;
+        }
+    }
+    if (n > 0) {
+        live_path(live, path, NULL, id, ".idx");
+        if (inverted_index_merge_files(inputs, n, path, COMPACT_BUF_SIZE) < 0
+            || fsync_path(path) < 0
+            || (*index = inverted_index_read_bin(path)) == NULL)
+            return -1;
+    }
+    for (i = n = 0; i < COMPACT_FANOUT; i++) {
+        if (run[i]->dc_index) {
+            live_path(live, names[n], NULL, run[i]->id, ".dc");
+            inputs[n] = names[n];
+            n++;
+        }
+    }
+    if (n > 0) {
+        live_path(live, path, NULL, id, ".dc");
+        if (dualclue_index_merge_files(inputs, n, path, COMPACT_BUF_SIZE) < 0
+            || fsync_path(path) < 0
+            || (*dc_index = dualclue_index_read_bin(path)) == NULL)
+            return -1;
+    }
+    return 0;
+}
+
+/** Remove the files of segment **id**, mapped copies stay readable until they are unmapped */
+static void segment_unlink(live_index_t* live, int id)
+{
+    char path[MAX_PATH_LENGTH];
+    live_path(live, path, NULL, id, ".idx");
+    unlink(path);
+    live_path(live, path, NULL, id, ".dc");
+    unlink(path);
+}
+
+/**
+ * Write the segment list of **snap** to a new MANIFEST, one "id level idx dc" line per segment,
+ * and rename it over the old one. Called with **publish_lock** held.
+ */
+static int live_write_manifest(live_index_t* live, live_snapshot_t* snap)
+{
+    FILE* fp;
+    int i, rv = 0;
+    char tmp[MAX_PATH_LENGTH], path[MAX_PATH_LENGTH];
+    
+    live_path(live, tmp, MANIFEST_NAME ".tmp", 0, NULL);
+    live_path(live, path, MANIFEST_NAME, 0, NULL);
+    if ( (fp = fopen(tmp, "w")) == NULL) {
+        perror("Failed to write MANIFEST");
+        return -1;
+    }
+    fprintf(fp, "# Version: %d\n", snap->version);
+    for (i = 0; i < snap->n_seg; i++) {
+        fprintf(fp, "%06d %d %d %d\n", snap->segs[i]->id, snap->segs[i]->level,
+                snap->segs[i]->index != NULL, snap->segs[i]->dc_index != NULL);
+    }
+    if (fflush(fp) != 0 || fsync(fileno(fp)) != 0)
+        rv = -1;
+    if (fclose(fp) != 0 || rv < 0 || rename(tmp, path) != 0) {
+        perror("Failed to write MANIFEST");
+        return -1;
+    }
+    /**
+     * The rename is durable once the directory is. It can no longer be undone, so the new
+     * version is installed even if this fails.
+     */
+    if (fsync_path(live->dir) < 0)
+        perror("Failed to sync the live index directory");
+    return 0;
+}
+
+/** Install **snap** as the current version, called with **publish_lock** held */
+static int live_swap(live_index_t* live, live_snapshot_t* snap)
+{
+    live_snapshot_t* old = live->current;
+    if (live->dir && live_write_manifest(live, snap) < 0)
+        return -1;
+    pthread_mutex_lock(&(live->lock));
+    live->current = snap;
+    pthread_mutex_unlock(&(live->lock));
+    /** the old version goes away with its last reader */
+    live_snapshot_release(old);
+    return 0;
+}
+
+/** A new version of **n_seg** segments, taking a reference to none of them yet */
+static live_snapshot_t* live_snapshot_alloc(live_index_t* live, int version, int n_seg)
+{
+    live_snapshot_t* snap = (live_snapshot_t*) malloc(sizeof(live_snapshot_t));
+    snap->refcount = 1;
+    snap->version = version;
+    snap->n_seg = n_seg;
+    snap->segs = (segment_t**) malloc((n_seg + 1) * sizeof(segment_t*));
+    snap->lm = live->lm;
+    return snap;
+}
+
+live_index_t* live_index_init(vocab_t* vocab, ngram_model_t* lm)
+{
+    live_index_t* live = (live_index_t*) calloc(1, sizeof(live_index_t));
+    live->vocab = vocab_retain(vocab);
+    live->lm = lm;
+    live->lm_index = inverted_index_init_vocab(vocab);
+    inverted_index_set_lm(live->lm_index, lm);
+    live->current = live_snapshot_alloc(live, 0, 0);
+    pthread_mutex_init(&(live->lock), NULL);
+    pthread_mutex_init(&(live->publish_lock), NULL);
+    pthread_mutex_init(&(live->compact_lock), NULL);
+    pthread_mutex_init(&(live->wake_lock), NULL);
+    pthread_cond_init(&(live->wake), NULL);
+    return live;
+}
+
+/**
+ * Remove the segment files no segment of **snap** owns, left by publications or compactions
+ * that failed or crashed before their MANIFEST was written, and any unfinished MANIFEST.
+ */
+static void live_sweep(live_index_t* live, live_snapshot_t* snap)
+{
+    DIR* d;
+    struct dirent* ent;
+    char path[MAX_PATH_LENGTH];
+    const char* ext;
+    int i, id, n;
+    
+    if ( (d = opendir(live->dir)) == NULL)
+        return;
+    while ( (ent = readdir(d)) != NULL) {
+        if (strcmp(ent->d_name, MANIFEST_NAME ".tmp") == 0) {
+            live_path(live, path, ent->d_name, 0, NULL);
+            unlink(path);
+            continue;
+        }
+        if (sscanf(ent->d_name, "%d%n", &id, &n) != 1 || n != 6)
+            continue;
+        ext = ent->d_name + n;
+        if (strcmp(ext, ".idx") != 0 && strcmp(ext, ".dc") != 0)
+            continue;
+        for (i = 0; i < snap->n_seg && snap->segs[i]->id != id; i++)
+            ;
+        if (i < snap->n_seg)
+            continue;
+        fprintf(stderr, "live_index_open: removing %06d%s, listed in no MANIFEST\n", id, ext);
+        live_path(live, path, NULL, id, ext);
+        unlink(path);
+    }
+    closedir(d);
+}
+
+live_index_t* live_index_open(const char* dir, vocab_t* vocab, ngram_model_t* lm)
+{
+    FILE* fp;
+    char line[MAX_LINE_LENGTH] = {'\0',};
+    char path[MAX_PATH_LENGTH];
+    int id, level, has_idx, has_dc, n_alloc = 0;
+    inverted_index_t* index;
+    dualclue_index_t* dc_index;
+    live_snapshot_t* snap;
+    live_index_t* live;
+    
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        perror("Failed to create the live index directory");
+        return NULL;
+    }
+    live = live_index_init(vocab, lm);
+    live->dir = strdup(dir);
+    snap = live->current;
+    
+    live_path(live, path, MANIFEST_NAME, 0, NULL);
+    if ( (fp = fopen(path, "r")) == NULL) {
+        live_sweep(live, snap);     /** a new index */
+        return live;
+    }
+    while (fgets(line, MAX_LINE_LENGTH, fp) != NULL) {
+        if (sscanf(line, "# Version: %d", &id) == 1) {
+            snap->version = id;
+            continue;
+        }
+        if (sscanf(line, "%d %d %d %d", &id, &level, &has_idx, &has_dc) != 4)
+            continue;
+        index = NULL;
+        dc_index = NULL;
+        if (has_idx) {
+            live_path(live, path, NULL, id, ".idx");
+            index = inverted_index_read_bin(path);
+        }
+        if (has_dc) {
+            live_path(live, path, NULL, id, ".dc");
+            dc_index = dualclue_index_read_bin(path);
+        }
+        if ((has_idx && !index) || (has_dc && !dc_index)) {
+            fprintf(stderr, "live_index_open: segment %06d is missing\n", id);
+            if (index)
+                inverted_index_free(index);
+            dualclue_index_free(dc_index);
+            fclose(fp);
+            live_index_free(live);
+            return NULL;
+        }
+        if (snap->n_seg == n_alloc) {
+            n_alloc = n_alloc ? n_alloc * 2 : 16;
+            snap->segs = (segment_t**) realloc(snap->segs, n_alloc * sizeof(segment_t*));
+        }
+        snap->segs[snap->n_seg++] = segment_init(live, id, level, index, dc_index);
+        if (id >= live->next_id)
+            live->next_id = id + 1;
+    }
+    fclose(fp);
+    live_sweep(live, snap);
+    return live;
+}
+
+void live_index_free(live_index_t* live)
+{
+    if (!live)
+        return;
+    if (live->compactor_running) {
+        pthread_mutex_lock(&(live->wake_lock));
+        live->stop = 1;
+        pthread_cond_signal(&(live->wake));
+        pthread_mutex_unlock(&(live->wake_lock));
+        pthread_join(live->compactor, NULL);
+    }
+    live_snapshot_release(live->current);
+    inverted_index_free(live->lm_index);
+    vocab_free(live->vocab);
+    free(live->dir);
+    pthread_mutex_destroy(&(live->lock));
+    pthread_mutex_destroy(&(live->publish_lock));
+    pthread_mutex_destroy(&(live->compact_lock));
+    pthread_mutex_destroy(&(live->wake_lock));
+    pthread_cond_destroy(&(live->wake));
+    free(live);
+}
+
+int live_index_publish(live_index_t* live, inverted_index_t* index, dualclue_index_t* dc_index)
+{
+    int i, id, version;
+    segment_t* seg;
+    live_snapshot_t *old, *snap;
+
+    if (!index && !dc_index) {
+        perror("live_index_publish: empty segment");
+        return -1;
+    }
+    /** the indexes are taken over even when they are refused */
+    if ( (index && !vocab_equal(inverted_index_get_vocab(index), live->vocab))
+        || (dc_index && !vocab_equal(dualclue_index_get_vocab(dc_index), live->vocab))) {
+        perror("live_index_publish: different word lists");
+        goto fail;
+    }
+    id = __sync_fetch_and_add(&(live->next_id), 1);
+    if (live->dir && segment_write(live, id, &index, &dc_index) < 0) {
+        segment_unlink(live, id);
+        goto fail;
+    }
+    seg = segment_init(live, id, 0, index, dc_index);
+
+    pthread_mutex_lock(&(live->publish_lock));
+    /** only the holder of **publish_lock** replaces **current**, so it is read without **lock** */
+    old = live->current;
+    snap = live_snapshot_alloc(live, old->version + 1, old->n_seg + 1);
+    for (i = 0; i < old->n_seg; i++) {
+        snap->segs[i] = old->segs[i];
+        __sync_fetch_and_add(&(snap->segs[i]->refcount), 1);
+    }
+    snap->segs[old->n_seg] = seg;
+    version = snap->version;
+    if (live_swap(live, snap) < 0) {
+        pthread_mutex_unlock(&(live->publish_lock));
+        live_snapshot_release(snap);
+        if (live->dir)
+            segment_unlink(live, id);
+        return -1;
+    }
+    /** past this point **snap** may already be replaced and freed by the compactor */
+    pthread_mutex_unlock(&(live->publish_lock));
+    
+    pthread_mutex_lock(&(live->wake_lock));
+    live->pending++;
+    pthread_cond_signal(&(live->wake));
+    pthread_mutex_unlock(&(live->wake_lock));
+    return version;
+
+fail:
+    if (index)
+        inverted_index_free(index);
+    dualclue_index_free(dc_index);
+    return -1;
+}
+
+/** First of **COMPACT_FANOUT** adjacent segments of the same level, -1 if there are none */
+static int live_find_run(live_snapshot_t* snap)
+{
+    int i, j;
+    for (i = 0; i + COMPACT_FANOUT <= snap->n_seg; i++) {
+        for (j = 1; j < COMPACT_FANOUT && snap->segs[i + j]->level == snap->segs[i]->level; j++)
+            ;
+        if (j == COMPACT_FANOUT)
+            return i;
+    }
+    return -1;
+}
+
+/** Merge one run of segments, returns 1 if a run was merged, 0 if there was none, -1 on error */
+static int live_compact_one(live_index_t* live)
+{
+    int i, first, id, rv = -1;
+    int has_idx = 0, has_dc = 0;
+    segment_t* run[COMPACT_FANOUT];
+    segment_t* seg;
+    inverted_index_t* index = NULL;
+    dualclue_index_t* dc_index = NULL;
+    live_snapshot_t *pinned, *snap, *cur;
+    
+    pinned = live_index_pin(live);
+    if ( (first = live_find_run(pinned)) < 0) {
+        live_snapshot_release(pinned);
+        return 0;
+    }
+    for (i = 0; i < COMPACT_FANOUT; i++) {
+        run[i] = pinned->segs[first + i];
+        has_idx |= run[i]->index != NULL;
+        has_dc |= run[i]->dc_index != NULL;
+    }
+    id = __sync_fetch_and_add(&(live->next_id), 1);
+    if (live->dir) {
+        /** the sources are immutable files, merged on disk without loading their hits */
+        if (segment_merge_files(live, id, run, &index, &dc_index) < 0) {
+            segment_unlink(live, id);
+            goto exit;
+        }
+    } else {
+        /** the sources are immutable, so they are read without any lock */
+        if (has_idx)
+            index = inverted_index_init_vocab(live->vocab);
+        if (has_dc)
+            dc_index = dualclue_index_init_vocab(live->vocab);
+        for (i = 0; i < COMPACT_FANOUT; i++) {
+            if ((run[i]->index && inverted_index_merge(index, run[i]->index) < 0)
+                || (run[i]->dc_index && dualclue_index_merge(dc_index, run[i]->dc_index) < 0))
+                goto exit;
+        }
+    }
+    seg = segment_init(live, id, run[0]->level + 1, index, dc_index);
+    index = NULL;
+    dc_index = NULL;
+    
+    /**
+     * Publications only append and there is one compaction at a time, so the run is still
+     * at **first** in the current version.
+     */
+    pthread_mutex_lock(&(live->publish_lock));
+    cur = live->current;
+    snap = live_snapshot_alloc(live, cur->version + 1, cur->n_seg - COMPACT_FANOUT + 1);
+    for (i = 0; i < first; i++) {
+        snap->segs[i] = cur->segs[i];
+    }
+    snap->segs[first] = seg;
+    for (i = first + COMPACT_FANOUT; i < cur->n_seg; i++) {
+        snap->segs[i - COMPACT_FANOUT + 1] = cur->segs[i];
+    }
+    for (i = 0; i < snap->n_seg; i++) {
+        if (snap->segs[i] != seg)
+            __sync_fetch_and_add(&(snap->segs[i]->refcount), 1);
+    }
+    if (live_swap(live, snap) < 0) {
+        pthread_mutex_unlock(&(live->publish_lock));
+        live_snapshot_release(snap);
+        if (live->dir)
+            segment_unlink(live, id);
+        goto exit;
+    }
+    pthread_mutex_unlock(&(live->publish_lock));
+    if (live->dir) {
+        for (i = 0; i < COMPACT_FANOUT; i++) {
+            segment_unlink(live, run[i]->id);
+        }
+    }
+    rv = 1;
+    
+exit:
+    if (index)
+        inverted_index_free(index);
+    dualclue_index_free(dc_index);
+    live_snapshot_release(pinned);
+    return rv;
+}
+
+int live_index_compact(live_index_t* live)
+{
+    int rv, n_merge = 0;
+    pthread_mutex_lock(&(live->compact_lock));
+    while ( (rv = live_compact_one(live)) > 0) {
+        n_merge++;
+    }
+    pthread_mutex_unlock(&(live->compact_lock));
+    return (rv < 0) ? -1 : n_merge;
+}
+
+static void* live_compactor(void* arg)
+{
+    live_index_t* live = (live_index_t*) arg;
+    pthread_mutex_lock(&(live->wake_lock));
+    while (!live->stop) {
+        if (live->pending == 0) {
+            pthread_cond_wait(&(live->wake), &(live->wake_lock));
+            continue;
+        }
+        live->pending = 0;
+        pthread_mutex_unlock(&(live->wake_lock));
+        if (live_index_compact(live) < 0)
+            fprintf(stderr, "live_compactor: compaction failed, retried after the next publication\n");
+        pthread_mutex_lock(&(live->wake_lock));
+    }
+    pthread_mutex_unlock(&(live->wake_lock));
+    return NULL;
+}
+
+int live_index_start_compactor(live_index_t* live)
+{
+    if (live->compactor_running)
+        return 0;
+    if (pthread_create(&(live->compactor), NULL, live_compactor, live) != 0) {
+        perror("live_index_start_compactor: failed to start a thread");
+        return -1;
+    }
+    live->compactor_running = 1;
+    return 0;
+}
+
+live_snapshot_t* live_index_pin(live_index_t* live)
+{
+    live_snapshot_t* snap;
+    pthread_mutex_lock(&(live->lock));
+    snap = live->current;
+    __sync_fetch_and_add(&(snap->refcount), 1);
+    pthread_mutex_unlock(&(live->lock));
+    return snap;
+}
+
+void live_snapshot_release(live_snapshot_t* snap)
+{
+    int i;
+    if (!snap || __sync_sub_and_fetch(&(snap->refcount), 1) > 0)
+        return;
+    for (i = 0; i < snap->n_seg; i++) {
+        segment_release(snap->segs[i]);
+    }
+    free(snap->segs);
+    free(snap);
+}
+
+int live_snapshot_version(live_snapshot_t* snap)
+{
+    return snap->version;
+}
+
+int live_snapshot_n_segment(live_snapshot_t* snap)
+{
+    return snap->n_seg;
+}
+
+/** result_cb_t collecting the results of one segment */
+static int ranking_add(const result_t* r, void* data)
+{
+    ranking_t* rk = (ranking_t*) data;
+    if (rk->n == rk->n_alloc) {
+        rk->n_alloc = rk->n_alloc ? rk->n_alloc * 2 : 64;
+        rk->items = (ranked_t*) realloc(rk->items, rk->n_alloc * sizeof(ranked_t));
+    }
+    rk->items[rk->n].r = *r;
+    rk->items[rk->n].r.next = NULL;
+    rk->items[rk->n].seq = rk->n;
+    rk->n++;
+    return 0;
+}
+
+/** Higher score first, then the order of arrival */
+static int ranked_cmp(const void* a, const void* b)
+{
+    const ranked_t* x = (const ranked_t*) a;
+    const ranked_t* y = (const ranked_t*) b;
+    if (x->r.score != y->r.score)
+        return (x->r.score > y->r.score) ? -1 : 1;
+    return x->seq - y->seq;
+}
+
+/** Rank the collected results and hand the **n_best** best ones to **cb** */
+static int ranking_flush(ranking_t* rk, int n_best, result_cb_t cb, void* data)
+{
+    int i, n;
+    qsort(rk->items, rk->n, sizeof(ranked_t), ranked_cmp);
+    n = (n_best <= 0 || n_best > rk->n) ? rk->n : n_best;
+    for (i = 0; i < n; i++) {
+        if (cb(&(rk->items[i].r), data)) {
+            i++;
+            break;
+        }
+    }
+    free(rk->items);
+    return i;
+}
+
+int live_snapshot_search_cb(live_snapshot_t* snap, float32 ascale, char** terms, int n_term, int n_best, result_cb_t cb, void* data)
+{
+    int i;
+    ranking_t rk = {0, 0, NULL};
+
+    /** every segment contributes its own **n_best**, enough for the best ones overall */
+    for (i = 0; i < snap->n_seg; i++) {
+        if (!snap->segs[i]->index)
+            continue;
+        if (inverted_index_search_cb(snap->segs[i]->index, snap->lm, ascale, terms, n_term, n_best, ranking_add, &rk) < 0) {
+            free(rk.items);
+            return -1;
+        }
+    }
+    return ranking_flush(&rk, n_best, cb, data);
+}
+
+int live_snapshot_dc_search_cb(live_snapshot_t* snap, char** terms, int n_term, int n_best, result_cb_t cb, void* data)
+{
+    int i;
+    ranking_t rk = {0, 0, NULL};
+
+    for (i = 0; i < snap->n_seg; i++) {
+        if (!snap->segs[i]->dc_index)
+            continue;
+        if (dualclue_index_search_cb(snap->segs[i]->dc_index, terms, n_term, n_best, ranking_add, &rk) < 0) {
+            free(rk.items);
+            return -1;
+        }
+    }
+    return ranking_flush(&rk, n_best, cb, data);
+}
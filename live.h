@@ -0,0 +1,116 @@
+/*************************************************************************************************
+ * live.h
+ * An index that can be searched while new recordings are indexed. It is a list of immutable
+ * segments, each a lattice index and/or a dual-clue index that no longer changes. Publishing a
+ * segment installs a new version of the list; a search pins the current version, which stays
+ * valid until it is released, and reads its segments without taking any lock.
+ *
+ * A live index may be kept in a directory: every segment is written once, as the binary files
+ * <id>.idx and <id>.dc, and a MANIFEST lists the segments of the current version, so adding
+ * recordings costs as much as writing them. Compaction merges four adjacent segments of the
+ * same level into one of the next level, keeping the number of segments logarithmic; in a
+ * directory their files are merged into the new ones through bounded buffers.
+ *
+ *************************************************************************************************/
+#ifndef __LIVE_H__
+#define __LIVE_H__
+
+#include "pocketsphinx.h"
+#include "index.h"
+#include "sausage.h"
+
+/**
+ * live_index_t
+ */
+typedef struct live_index_s live_index_t;
+
+/**
+ * live_snapshot_t
+ * A pinned version of a live index: a fixed list of segments
+ */
+typedef struct live_snapshot_s live_snapshot_t;
+
+/**
+ * function: live_index_init()
+ * Create an empty live index over **vocab**. Lattice index segments are searched with **lm**,
+ * which must outlive the live index.
+ */
+live_index_t* live_index_init(vocab_t* vocab, ngram_model_t* lm);
+
+/**
+ * function: live_index_open()
+ * Open the live index kept in directory **dir**, created if it does not exist, and map the
+ * segments listed in its MANIFEST. Returns NULL on error.
+ */
+live_index_t* live_index_open(const char* dir, vocab_t* vocab, ngram_model_t* lm);
+
+/**
+ * function: live_index_free()
+ * Stop the compactor and free the live index; segments still held by a snapshot are freed
+ * with it
+ */
+void live_index_free(live_index_t* live);
+
+/**
+ * function: live_index_publish()
+ * Add a segment made of **index** and **dc_index**, either may be NULL. The live index takes
+ * both over, they must not be modified afterwards; in a directory they are written out and
+ * replaced by mapped copies. Searches already running keep the version they pinned. Both
+ * must use the words of the live index. Returns the new version number, -1 on error; the
+ * indexes are freed in every case.
+ */
+int live_index_publish(live_index_t* live, inverted_index_t* index, dualclue_index_t* dc_index);
+
+/**
+ * function: live_index_compact()
+ * Merge segments until no four adjacent ones share a level. Publications and searches
+ * go on meanwhile. Returns the number of merges, -1 on error.
+ */
+int live_index_compact(live_index_t* live);
+
+/**
+ * function: live_index_start_compactor()
+ * Run live_index_compact() in a background thread after every publication
+ */
+int live_index_start_compactor(live_index_t* live);
+
+/**
+ * function: live_index_pin()
+ * Return the current version, to be released with live_snapshot_release()
+ */
+live_snapshot_t* live_index_pin(live_index_t* live);
+
+/**
+ * function: live_snapshot_release()
+ * Release a pinned version
+ */
+void live_snapshot_release(live_snapshot_t* snap);
+
+/**
+ * function: live_snapshot_version()
+ * Return the version number, the number of publications before it
+ */
+int live_snapshot_version(live_snapshot_t* snap);
+
+/**
+ * function: live_snapshot_n_segment()
+ * Return the number of segments
+ */
+int live_snapshot_n_segment(live_snapshot_t* snap);
+
+/**
+ * function: live_snapshot_search_cb()
+ * Search the lattice indexes of every segment and hand the **n_best** best spans to **cb**,
+ * best first, all of them if **n_best** <= 0. Utterance ordinals are those of the segment the
+ * span was found in and **uttid** stays valid until the snapshot is released.
+ * Returns the number of results handed to **cb**, -1 on error.
+ */
+int live_snapshot_search_cb(live_snapshot_t* snap, float32 ascale, char** terms, int n_term, int n_best, result_cb_t cb, void* data);
+
+/**
+ * function: live_snapshot_dc_search_cb()
+ * Same as live_snapshot_search_cb() over the dual-clue indexes
+ */
+int live_snapshot_dc_search_cb(live_snapshot_t* snap, char** terms, int n_term, int n_best, result_cb_t cb, void* data);
+
+#endif
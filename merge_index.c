@@ -0,0 +1,44 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "index.h"
+#include "sausage.h"
+
+#define DEFAULT_BUF_SIZE (4 << 20)
+
+/**
+ * Merge binary index shards, e.g. one per day or per channel:
+ *   merge_index [-b BUFFER_KB] lattice|dualclue OUTPUT INPUT...
+ */
+int main(int argc, char** argv)
+{
+    int i = 1;
+    size_t buf_size = DEFAULT_BUF_SIZE;
+    const char* type;
+    const char* output;
+    int rv;
+    
+    if (argc > 2 && strcmp(argv[1], "-b") == 0) {
+        buf_size = (size_t) atol(argv[2]) << 10;
+        i = 3;
+    }
+    if (argc - i < 3) {
+        fprintf(stderr, "Usage: %s [-b BUFFER_KB] lattice|dualclue OUTPUT INPUT...\n", argv[0]);
+        return 1;
+    }
+    type = argv[i];
+    output = argv[i+1];
+    if (strcmp(type, "lattice") == 0) {
+        rv = inverted_index_merge_files((const char* const*) argv + i + 2, argc - i - 2, output, buf_size);
+    } else if (strcmp(type, "dualclue") == 0) {
+        rv = dualclue_index_merge_files((const char* const*) argv + i + 2, argc - i - 2, output, buf_size);
+    } else {
+        fprintf(stderr, "Unknown index type: %s\n", type);
+        return 1;
+    }
+    if (rv < 0)
+        return 1;
+    printf("Merged %d indexes into %s\n", argc - i - 2, output);
+    return 0;
+}
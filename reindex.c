@@ -0,0 +1,71 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "artifact.h"
+
+/**
+ * Rebuild the indexes from an artifact archive written by ingest, without decoding again:
+ *   reindex [-p MIN_POSTERIOR] [-c MAX_HITS_PER_SEC] [-m] [-a ASCALE] ARCHIVE INDEX [DUALCLUE_INDEX]
+ * -m collapses the overlapping hits of a word, see inverted_index_set_collapse(), and ASCALE is
+ * the -ascale the lattices were decoded with.
+ */
+int main(int argc, char** argv)
+{
+    int i;
+    float64 min_posterior = 0;
+    float32 max_hits_per_sec = 0;
+    float32 ascale = 20.0;
+    int collapse = 0;
+    artifact_t* a;
+    inverted_index_t* index;
+    dualclue_index_t* dc_index = NULL;
+    inverted_index_stats_t stats;
+    int n_utt;
+    
+    for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "-m") == 0) {
+            collapse = 1;
+        } else if (i + 1 < argc && strcmp(argv[i], "-p") == 0) {
+            min_posterior = atof(argv[++i]);
+        } else if (i + 1 < argc && strcmp(argv[i], "-c") == 0) {
+            max_hits_per_sec = atof(argv[++i]);
+        } else if (i + 1 < argc && strcmp(argv[i], "-a") == 0) {
+            ascale = atof(argv[++i]);
+        } else {
+            break;
+        }
+    }
+    if (argc - i < 2) {
+        fprintf(stderr, "Usage: %s [-p MIN_POSTERIOR] [-c MAX_HITS_PER_SEC] [-m] [-a ASCALE] "
+                "ARCHIVE INDEX [DUALCLUE_INDEX]\n", argv[0]);
+        return 1;
+    }
+    if ( (a = artifact_open(argv[i])) == NULL) 
+        return 1;
+    
+    /** the indexes take the words of the archive */
+    index = inverted_index_init_vocab(artifact_get_vocab(a));
+    inverted_index_set_pruning(index, min_posterior, max_hits_per_sec);
+    inverted_index_set_collapse(index, collapse);
+    if (argc - i > 2) {
+        dc_index = dualclue_index_init_vocab(artifact_get_vocab(a));
+        dualclue_index_set_uttdict(dc_index, inverted_index_get_uttdict(index));
+    }
+    
+    if ( (n_utt = artifact_reindex(a, index, dc_index, 1.0/ascale)) < 0) 
+        return 1;
+    printf("Reindexed %d utterances\n", n_utt);
+    inverted_index_get_stats(index, &stats);
+    printf("Links: %ld, pruned by posterior: %ld, collapsed: %ld, by cap: %ld, indexed: %ld\n",
+            stats.n_link, stats.n_pruned_posterior, stats.n_collapsed, stats.n_pruned_cap, stats.n_hit);
+    
+    inverted_index_write_bin(index, argv[i+1]);
+    if (dc_index) {
+        dualclue_index_write_bin(dc_index, argv[i+2]);
+        dualclue_index_free(dc_index);
+    }
+    inverted_index_free(index);
+    artifact_close(a);
+    return 0;
+}
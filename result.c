@@ -0,0 +1,116 @@
+#include <stdlib.h>
+#include "result.h"
+
+struct result_list_s {
+    int n_result;
+    result_t *first;
+    result_t *last;
+};
+
+result_list_t* result_list_init(void)
+{
+    return (result_list_t*) calloc(1, sizeof(result_list_t));
+}
+
+void result_list_free(result_list_t* rl)
+{
+    result_t *r, *next;
+    if (!rl)
+        return;
+    for (r = rl->first; r; r = next) {
+        next = r->next;
+        free(r);
+    }
+    free(rl);
+}
+
+int result_list_add(const result_t* r, void* data)
+{
+    result_list_t* rl = (result_list_t*) data;
+    result_t* copy = (result_t*) malloc(sizeof(result_t));
+    *copy = *r;
+    copy->next = NULL;
+    if (rl->last) {
+        rl->last->next = copy;
+    } else {
+        rl->first = copy;
+    }
+    rl->last = copy;
+    rl->n_result++;
+    return 0;
+}
+
+int result_list_size(result_list_t* rl)
+{
+    return rl->n_result;
+}
+
+const result_t* result_list_first(result_list_t* rl)
+{
+    return rl->first;
+}
+
+/** Nonzero if **a** ranks below **b** */
+static int result_rank_worse(const result_rank_t* a, const result_rank_t* b)
+{
+    return a->score < b->score 
+        || (a->score == b->score && a->seq > b->seq);
+}
+
+/** Restore the heap below **i**; the worst entry is kept at the root */
+static void result_rank_sift_down(result_rank_t* heap, int n, int i)
+{
+    int c;
+    result_rank_t tmp;
+    while ( (c = 2 * i + 1) < n) {
+        if (c + 1 < n && result_rank_worse(&heap[c+1], &heap[c]))
+            c++;
+        if (!result_rank_worse(&heap[c], &heap[i]))
+            break;
+        tmp = heap[i];
+        heap[i] = heap[c];
+        heap[c] = tmp;
+        i = c;
+    }
+}
+
+static void result_rank_sift_up(result_rank_t* heap, int i)
+{
+    result_rank_t tmp;
+    while (i > 0 && result_rank_worse(&heap[i], &heap[(i-1)/2])) {
+        tmp = heap[i];
+        heap[i] = heap[(i-1)/2];
+        heap[(i-1)/2] = tmp;
+        i = (i - 1) / 2;
+    }
+}
+
+int result_rank_add(result_rank_t* heap, int n, int k, void* item, int32 score, int seq)
+{
+    if (n < k) {
+        heap[n].item = item;
+        heap[n].score = score;
+        heap[n].seq = seq;
+        result_rank_sift_up(heap, n);
+        return n + 1;
+    }
+    if (n > 0 && heap[0].score < score) {
+        heap[0].item = item;
+        heap[0].score = score;
+        heap[0].seq = seq;
+        result_rank_sift_down(heap, n, 0);
+    }
+    return n;
+}
+
+void result_rank_sort(result_rank_t* heap, int n)
+{
+    result_rank_t tmp;
+    /** moving the worst to the back leaves the best in front */
+    while (n > 1) {
+        tmp = heap[0];
+        heap[0] = heap[--n];
+        heap[n] = tmp;
+        result_rank_sift_down(heap, n, 0);
+    }
+}
@@ -0,0 +1,94 @@
+/*************************************************************************************************
+ * result.h
+ * Ranked search results shared by the lattice index and the dual-clue index. A search either
+ * hands every result to a callback, best first, which may stop receiving them, or collects them
+ * in a result list.
+ *
+ *************************************************************************************************/
+#ifndef __RESULT_H__
+#define __RESULT_H__
+
+#include "pocketsphinx.h"
+
+/**
+ * result_t
+ * One matched span. Lattice index results span frames and carry the frame rate, dual-clue
+ * index results span sausage slots and have a frame rate of 0.
+ */
+typedef struct result_s {
+    int32 utt;          /** utterance ordinal in the index's uttdict */
+    const char* uttid;  /** utterance id, owned by the index's uttdict */
+    int32 start;        /** first frame, or first slot */
+    int32 end;          /** last frame, or last slot */
+    int32 frate;        /** frames per second of **start** and **end**, 0 for slots */
+    int32 score;        /** posterior log-likelihood of the span */
+    struct result_s* next;
+} result_t;
+
+/**
+ * result_list_t
+ */
+typedef struct result_list_s result_list_t;
+
+/**
+ * result_cb_t
+ * Called for each result, best first; return nonzero to stop receiving results
+ */
+typedef int (*result_cb_t)(const result_t* r, void* data);
+
+/**
+ * function: result_list_init()
+ * Create an empty result list
+ */
+result_list_t* result_list_init(void);
+
+/**
+ * function: result_list_free()
+ * Free a result list and its results
+ */
+void result_list_free(result_list_t* rl);
+
+/**
+ * function: result_list_add()
+ * Append a copy of **r**; a result_cb_t taking the list as **data**, it never stops the search
+ */
+int result_list_add(const result_t* r, void* rl);
+
+/**
+ * function: result_list_size()
+ * Return the number of results
+ */
+int result_list_size(result_list_t* rl);
+
+/**
+ * function: result_list_first()
+ * Return the best result, the others follow through **next**; NULL if the list is empty
+ */
+const result_t* result_list_first(result_list_t* rl);
+
+/**
+ * result_rank_t
+ * Entry of the bounded top-K heap both searches rank their paths with; **seq** is the order
+ * in which the entry was offered and breaks ties in favour of the earlier one.
+ */
+typedef struct result_rank_s {
+    void* item;
+    int32 score;
+    int seq;
+} result_rank_t;
+
+/**
+ * function: result_rank_add()
+ * Offer **item** with **score** to **heap**, which holds **n** of at most **k** entries; a later
+ * item only replaces the worst one if it scores strictly better. Returns the new number of
+ * entries.
+ */
+int result_rank_add(result_rank_t* heap, int n, int k, void* item, int32 score, int seq);
+
+/**
+ * function: result_rank_sort()
+ * Sort the **n** entries of **heap** in place, best first and ties in the order offered
+ */
+void result_rank_sort(result_rank_t* heap, int n);
+
+#endif
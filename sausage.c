@@ -1,4 +1,12 @@
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
 #include "sausage.h"
+#include "bufio.h"
+#include "arena.h"
 
 #define MATCH 0
 #define MISMATCH 2
@@ -7,6 +15,12 @@
 
 #define WORD_MAX_LENGTH 15
 #define MAX_LINE_LENGTH 256
+#define N_STRIPE 64     /** locks guarding the word postings while stages are published */
+#define SAUSAGE_ARENA_BLOCK (64 * 1024)    /** bytes the arena of a sausage grows by */
+
+/** binary dual-clue index: magic and format version */
+#define DUALCLUE_BIN_MAGIC "SDRDIDX"
+#define DUALCLUE_BIN_VERSION 3
 
 struct node_s {
     ps_latnode_t *node;
@@ -36,31 +50,50 @@ struct edge_s {
     edge_t *next;   
 };
 
+/** one word of an edge_set and the number of its edges */
+typedef struct word_count_s {
+    int32 wid;          /** -1 if the word is not in the similarity table */
+    int32 count;
+    const char* word;
+} word_count_t;
+
 struct edge_set_s {
     int from_ns_id, to_ns_id;   /** edge_set is between <from_ns_id> and <to_ns_id> */
     node_set_t *from, *to;
     int n_edge; /**total number of edges inside a edge_set */
     edge_t* edges;    /** edges in original lattice contained in this edge_set */
     edge_t* last_edge;
+    
+    word_count_t* words;    /** distinct words of the edges, in order of first appearance */
+    int n_word, n_word_alloc;
+};
+
+struct sim_table_s {
+    vocab_t* vocab;
+    int n_word;
+    uint8* cost;    /** edit cost of every pair of words, row major */
 };
 
 struct sausage_s {
     node_set_t* nodesets;
     int n_nodeset;
+    arena_t* arena;     /** the sausage and all its sets, released at once */
 };
 
 
 
 
-int node_set_add(node_set_t* ns, ps_latnode_t* node)
+/** **ns_of** maps the id of every lattice node added so far to its node set */
+int node_set_add(node_set_t* ns, ps_latnode_t* node, node_set_t** ns_of, arena_t* arena)
 {
     if (!ns || !node)
         return -1;
         
     node_t *n;
+    ns_of[ps_latnode_get_id(node)] = ns;
     int t = ps_latnode_times(node, NULL, NULL);
     
-    n = (node_t*) malloc(sizeof(node_t));
+    n = (node_t*) arena_alloc(arena, sizeof(node_t));
     n->node = node;
     n->next = NULL;
     
@@ -84,13 +117,13 @@ int node_set_add(node_set_t* ns, ps_latnode_t* node)
     return 0;
 }
 
-int edge_set_add(edge_set_t* es, ps_latlink_t* link)
+int edge_set_add(edge_set_t* es, ps_latlink_t* link, arena_t* arena)
 {
     if ( !es || !link)
         return -1;
         
     edge_t *e;
-    e = (edge_t*) malloc(sizeof(edge_t));
+    e = (edge_t*) arena_alloc(arena, sizeof(edge_t));
     e->edge = link;
     e->next = NULL;
     if (!es->edges) {
@@ -106,34 +139,26 @@ int edge_set_add(edge_set_t* es, ps_latlink_t* link)
 /** To tell whether there is a link between node n and any nodes inside node_set ns
  *  Return 1 means YES, 0 means NO
  */
-int node_set_has_connection(node_set_t* ns, ps_latnode_t* node)
+int node_set_has_connection(node_set_t* ns, ps_latnode_t* node, node_set_t** ns_of)
 {
     /** Go through all entries of latnode n to see if there is a link whose from node'id inside node_set */
     ps_latlink_iter_t *iter;
     ps_latlink_t *l;
     ps_latnode_t *d;
-    node_t* n;
     for (iter = ps_latnode_entries(node); iter; iter = ps_latlink_iter_next(iter)) {
         l = ps_latlink_iter_link(iter);
         ps_latlink_nodes(l, &d);
-        for (n = ns->nodes; n; n = n->next) {
-            if ( d == n->node ) {
-                return 1;
-            }
+        if (ns_of[ps_latnode_get_id(d)] == ns) {
+            ps_latlink_iter_free(iter);
+            return 1;
         }
     }
     return 0;
 }
 
-int node_set_contains(node_set_t* ns, ps_latnode_t* node)
+int node_set_contains(node_set_t* ns, ps_latnode_t* node, node_set_t** ns_of)
 {
-    node_t* n;
-    for (n = ns->nodes; n; n = n->next) {
-            if (node == n->node) {
-                return 1;
-            }
-    }
-    return 0;
+    return ns_of[ps_latnode_get_id(node)] == ns;
 }
 
 /***
@@ -143,43 +168,129 @@ int node_set_contains(node_set_t* ns, ps_latnode_t* node)
  * 
  */
 
-double similarity_of_words(const char* s, const char* t)
+static int edit_cost(const char* s, const char* t)
 {
     int m, n; 
-    int i, j, k;
-    int cost_m, cost_i, cost_d;
-    int cost;
+    int i, j;
+    int cost_m, cost_i, cost_d, smaller;
+    int diag, up;
+    int buf[MAX_LINE_LENGTH];
+    int* vcost = buf;
     m = strlen(s);
     n = strlen(t);
-    int** vcost = (int**) calloc(m+1, sizeof(int*));
-    for (k = 0; k < m+1; k++) {
-        vcost[k] = (int*) calloc(n+1, sizeof(int));
-    } 
+    /** one row of the matrix is enough, **diag** keeps the cell overwritten last */
+    if (n + 1 > MAX_LINE_LENGTH)
+        vcost = (int*) malloc((n + 1) * sizeof(int));
     
-    vcost[0][0] = 0;
-    for (i = 1; i < m+1; i++) {
-        vcost[i][0] = vcost[i-1][0] + DELETE;
-    }
-    for (j = 1; j < n+1; j++) {
-        vcost[0][j] = vcost[0][j-1] + INSERT;
+    for (j = 0; j < n+1; j++) {
+        vcost[j] = j * INSERT;
     }
     for (i = 1; i < m+1; i++) {
+        diag = vcost[0];
+        vcost[0] = i * DELETE;
         for (j = 1; j < n+1; j++) {
-           cost_m = vcost[i-1][j-1]  + ((s[i-1] == t[j-1]) ? MATCH : MISMATCH);
-           cost_i = vcost[i][j-1] + INSERT;
-           cost_d = vcost[i-1][j] + DELETE;
-           int smaller = (cost_m < cost_i) ? cost_m : cost_i;
-           vcost[i][j] = (smaller < cost_d) ? smaller : cost_d;     
+           up = vcost[j];
+           cost_m = diag + ((s[i-1] == t[j-1]) ? MATCH : MISMATCH);
+           cost_i = vcost[j-1] + INSERT;
+           cost_d = up + DELETE;
+           smaller = (cost_m < cost_i) ? cost_m : cost_i;
+           vcost[j] = (smaller < cost_d) ? smaller : cost_d;     
+           diag = up;
         }
     }
     
+    smaller = vcost[n];
+    if (vcost != buf)
+        free(vcost);
+    return smaller;
+}
+
+double similarity_of_words(const char* s, const char* t)
+{
+   return  1.0/(edit_cost(s, t) + 1);
+}
+
+sim_table_t* sim_table_init(vocab_t* vocab)
+{
+    sim_table_t* sim;
+    int i, j, cost;
     
-   cost = vcost[m][n];
-   for (k = 0; k < m+1; k++) {
-        free(vcost[k]);
-    } 
-   free(vcost);
-   return  1.0/(cost + 1);
+    if (!vocab) {
+        perror("sim_table_init: no vocabulary");
+        return NULL;
+    }
+    sim = (sim_table_t*) malloc(sizeof(sim_table_t));
+    sim->vocab = vocab_retain(vocab);
+    sim->n_word = vocab_size(vocab);
+    sim->cost = (uint8*) malloc((size_t) sim->n_word * sim->n_word * sizeof(uint8));
+    for (i = 0; i < sim->n_word; i++) {
+        sim->cost[(size_t) i * sim->n_word + i] = 0;
+        for (j = i + 1; j < sim->n_word; j++) {
+            cost = edit_cost(vocab_word(vocab, i), vocab_word(vocab, j));
+            if (cost > 255)
+                cost = 255;
+            sim->cost[(size_t) i * sim->n_word + j] = sim->cost[(size_t) j * sim->n_word + i] = (uint8) cost;
+        }
+    }
+    return sim;
+}
+
+void sim_table_free(sim_table_t* sim)
+{
+    if (!sim)
+        return;
+    vocab_free(sim->vocab);
+    free(sim->cost);
+    free(sim);
+}
+
+/** wid of **word** in the table, -1 if it has none */
+static int32 sim_table_wid(sim_table_t* sim, const char* word)
+{
+    return sim ? vocab_wid(sim->vocab, word) : -1;
+}
+
+/** Count one more edge of **word** in **es** */
+static void edge_set_count_word(edge_set_t* es, int32 wid, const char* word, arena_t* arena)
+{
+    int i;
+    word_count_t* w;
+    for (i = 0; i < es->n_word; i++) {
+        w = &(es->words[i]);
+        if ( (wid >= 0) ? (w->wid == wid) : (w->wid < 0 && strcmp(w->word, word) == 0) ) {
+            w->count++;
+            return;
+        }
+    }
+    if (es->n_word == es->n_word_alloc) {
+        /** the old array is left in the arena, at most as much as the new one */
+        es->n_word_alloc = es->n_word_alloc ? es->n_word_alloc * 2 : 8;
+        w = (word_count_t*) arena_alloc(arena, es->n_word_alloc * sizeof(word_count_t));
+        if (es->n_word)
+            memcpy(w, es->words, es->n_word * sizeof(word_count_t));
+        es->words = w;
+    }
+    w = &(es->words[es->n_word++]);
+    w->wid = wid;
+    w->count = 1;
+    w->word = word;
+}
+
+/** SIM(E, e): the similarities of **word** to the words of the edges of **es**, summed */
+static double edge_set_similarity(edge_set_t* es, sim_table_t* sim, int32 wid, const char* word)
+{
+    int i;
+    double total = 0;
+    const uint8* row = (wid >= 0) ? sim->cost + (size_t) wid * sim->n_word : NULL;
+    word_count_t* w;
+    for (i = 0; i < es->n_word; i++) {
+        w = &(es->words[i]);
+        if (row && w->wid >= 0) 
+            total += w->count / (double)(row[w->wid] + 1);
+        else
+            total += w->count * similarity_of_words(w->word, word);
+    }
+    return total;
 }
 
 double overlap(edge_set_t* es, ps_latlink_t* l) 
@@ -225,17 +336,23 @@ double overlap(edge_set_t* es, ps_latlink_t* l)
  * PAPER: IMPROVED CONFUSION NETWORK ALGORITHM AND SHORTEST PATH SEARCH
  * 
  */
-sausage_t* convert_lattice_to_sausage(ps_lattice_t* dag)
+sausage_t* convert_lattice_to_sausage(ps_lattice_t* dag, sim_table_t* sim)
 {
     int i;
-    int n_node;
+    int n_node, max_id;
     ps_latnode_iter_t* itor;
     ps_latnode_t* node;
     
     n_node = 0;
+    max_id = -1;
     for (itor = ps_latnode_iter(dag); itor; itor = ps_latnode_iter_next(itor)){
+        if (ps_latnode_get_id(ps_latnode_iter_node(itor)) > max_id)
+            max_id = ps_latnode_get_id(ps_latnode_iter_node(itor));
         n_node++;
     }
+    /** node set of each lattice node by id, NULL until the node is assigned */
+    node_set_t** ns_of;
+    ns_of = (node_set_t**) calloc(max_id + 1, sizeof(node_set_t*));
     ps_latnode_t** node_stack;
     node_stack = (ps_latnode_t**) malloc( n_node * sizeof(ps_latnode_t*) );
     for (i = 0, itor = ps_latnode_iter(dag); i < n_node && itor; i++, itor = ps_latnode_iter_next(itor)) {
@@ -243,11 +360,13 @@ sausage_t* convert_lattice_to_sausage(ps_lattice_t* dag)
     }
     
     sausage_t* sausage;
-    sausage = (sausage_t*) malloc( sizeof(sausage) );
+    arena_t* arena = arena_init(SAUSAGE_ARENA_BLOCK);
+    sausage = (sausage_t*) arena_alloc(arena, sizeof(sausage_t) );
+    sausage->arena = arena;
     sausage->nodesets = NULL;
     sausage->n_nodeset = 0;
     // Assign initial node n_0 to NS_0
-    sausage->nodesets = (node_set_t*) malloc( sizeof(node_set_t) );
+    sausage->nodesets = (node_set_t*) arena_alloc(arena, sizeof(node_set_t) );
     sausage->nodesets->ns_id = 0;
     
     sausage->nodesets->nodes = NULL;
@@ -264,18 +383,20 @@ sausage_t* convert_lattice_to_sausage(ps_lattice_t* dag)
     
     sausage->n_nodeset++;
     
-    if ( 0 != node_set_add(sausage->nodesets, node_stack[n_node-1]) ) {
+    if ( 0 != node_set_add(sausage->nodesets, node_stack[n_node-1], ns_of, arena) ) {
         perror("Assign initial node to First Node Set error");
-        // need to do some cleaning
+        arena_free(arena);
+        free(ns_of);
+        free(node_stack);
         return NULL;
     } 
     node_set_t *ns = sausage->nodesets;
     for ( i = n_node - 2; i >= 0; i--) {
         node = node_stack[i];
-        if ( 1 == node_set_has_connection(ns, node)) {
+        if ( 1 == node_set_has_connection(ns, node, ns_of)) {
             // Construct a new node set
             node_set_t *new_ns;
-            new_ns = (node_set_t*) malloc( sizeof(node_set_t) );
+            new_ns = (node_set_t*) arena_alloc(arena, sizeof(node_set_t) );
             sausage->n_nodeset++;
             new_ns->ns_id = ns->ns_id + 1;
             
@@ -292,7 +413,7 @@ sausage_t* convert_lattice_to_sausage(ps_lattice_t* dag)
             new_ns->t_min = new_ns->t_max = 0;
             // construct a new edge set between ns and new_ns
             edge_set_t* es;
-            es = (edge_set_t*) malloc( sizeof(edge_set_t) );
+            es = (edge_set_t*) arena_alloc(arena, sizeof(edge_set_t) );
             es->from_ns_id = ns->ns_id;
             es->to_ns_id = new_ns->ns_id;
             es->from = ns;
@@ -300,6 +421,8 @@ sausage_t* convert_lattice_to_sausage(ps_lattice_t* dag)
             es->n_edge = 0;
             es->edges = NULL;
             es->last_edge = NULL;
+            es->words = NULL;
+            es->n_word = es->n_word_alloc = 0;
             
             new_ns->entry = es;
             ns->exit = es;
@@ -310,7 +433,7 @@ sausage_t* convert_lattice_to_sausage(ps_lattice_t* dag)
             ns = new_ns;
         }
         // add latnode to current node set
-        if ( node_set_add(ns, node) != 0) {
+        if ( node_set_add(ns, node, ns_of, arena) != 0) {
             perror("Failed to add latnode to node set");
         }
               
@@ -318,59 +441,249 @@ sausage_t* convert_lattice_to_sausage(ps_lattice_t* dag)
         ps_latnode_t* from;
         ps_latlink_t* link;
         ps_latlink_iter_t* itor;
+        const char* word;
+        int32 wid;
         for ( itor = ps_latnode_entries(node); itor; itor = ps_latlink_iter_next(itor)) {
             link = ps_latlink_iter_link(itor);
             ps_latlink_nodes(link, &from);
+            word = ps_latlink_word(dag, link);
+            wid = sim_table_wid(sim, word);
             node_set_t* locator;
-            for (locator = ns->prev; locator; locator = locator->prev) {
-            
-                if (1 == node_set_contains(locator, from) ) {
-                   break;
-                }
-                
-            }
-            if (!locator) {
+            locator = ns_of[ps_latnode_get_id(from)];
+            if (!locator || locator == ns) {
                 perror("Impossible: ");
-                // ...
+                continue;
             }
             // 
             if ( (ns->ns_id - locator->ns_id) == 1) {
                 // assign edge to to the edge set which is between node set <ns> and node set <locator> directly
-                if ( 0 != edge_set_add(ns->entry, link) ) {
+                if ( 0 != edge_set_add(ns->entry, link, arena) ) {
                     perror("Failed to add latlink to edge set");
                     // need to do some cleaning
                 }
+                edge_set_count_word(ns->entry, wid, word, arena);
                 
             } else { // Assign edge to one of edge sets between <ns> and <locator>
-                double sim = 0, tsim = 0, bstsim = 0;
-                edge_t* e; 
+                double sim_sum = 0, tsim = 0, bstsim = 0;
                 node_set_t *cur_ns, *bst_ns;
                 for (cur_ns = locator; cur_ns != ns; cur_ns = cur_ns->next) {
-                    // caculate SIM(E, e)
-                    
-                    for (e = cur_ns->exit->edges; e; e = e->next) {
-                        sim += similarity_of_words(ps_latlink_word(dag, e->edge), ps_latlink_word(dag,link));
-                    }
-                    tsim =  sim * overlap(cur_ns->exit, link) / cur_ns->exit->n_edge;
+                    // caculate SIM(E, e), a lookup per distinct word of the edge set
+                    sim_sum += edge_set_similarity(cur_ns->exit, sim, wid, word);
+                    tsim =  sim_sum * overlap(cur_ns->exit, link) / cur_ns->exit->n_edge;
                     
                     if (tsim >= bstsim) {
                         bstsim = tsim;
                         bst_ns = cur_ns;
                     }
                 }                
-                if ( 0 != edge_set_add(bst_ns->exit, link) ) {
+                if ( 0 != edge_set_add(bst_ns->exit, link, arena) ) {
                     perror("Failed to add latlink to edge set");
                     // need to do some cleaning
                 }
+                edge_set_count_word(bst_ns->exit, wid, word, arena);
             }
             
         }
         
     }
+    free(ns_of);
+    free(node_stack);
+    return sausage;
+}
+
+/** An empty node set with id **ns_id**, appended after **prev** and joined to it by an empty edge set */
+static node_set_t* node_set_append(node_set_t* prev, int ns_id, arena_t* arena)
+{
+    node_set_t* ns = (node_set_t*) arena_calloc(arena, 1, sizeof(node_set_t));
+    edge_set_t* es;
+    ns->ns_id = ns_id;
+    if (prev) {
+        es = (edge_set_t*) arena_calloc(arena, 1, sizeof(edge_set_t));
+        es->from_ns_id = prev->ns_id;
+        es->to_ns_id = ns_id;
+        es->from = prev;
+        es->to = ns;
+        prev->exit = ns->entry = es;
+        prev->next = ns;
+        ns->prev = prev;
+    }
+    return ns;
+}
+
+/**
+ * PIVOT ALIGNMENT
+ * The slots are the links of a pivot path, the path whose link posteriors have the largest
+ * sum, and every other link goes to the slot it overlaps most in time. Words are not compared,
+ * so one pass over the lattice is enough, but a link straddling two slots may be put beside
+ * other words than convert_lattice_to_sausage() would.
+ */
+sausage_t* convert_lattice_to_sausage_pivot(ps_lattice_t* dag)
+{
+    int i, j, lo, hi;
+    int n_node, max_id, n_slot, id, best, ov, best_ov;
+    int n_link = 0, n_link_alloc = 0;
+    int16 sf;
+    int ef;
+    ps_latnode_iter_t* itor;
+    ps_latlink_iter_t* litor;
+    ps_latnode_t *node, *from, *last;
+    ps_latlink_t* link;
+    ps_latlink_t** links = NULL;
+
+    n_node = 0;
+    max_id = -1;
+    for (itor = ps_latnode_iter(dag); itor; itor = ps_latnode_iter_next(itor)) {
+        if (ps_latnode_get_id(ps_latnode_iter_node(itor)) > max_id)
+            max_id = ps_latnode_get_id(ps_latnode_iter_node(itor));
+        n_node++;
+    }
+    if (n_node == 0) {
+        perror("convert_lattice_to_sausage_pivot: empty lattice");
+        return NULL;
+    }
+    /** the first node of the iteration is the final one, the last is the initial one */
+    ps_latnode_t** node_stack = (ps_latnode_t**) malloc(n_node * sizeof(ps_latnode_t*));
+    for (i = 0, itor = ps_latnode_iter(dag); i < n_node && itor; i++, itor = ps_latnode_iter_next(itor)) {
+        node_stack[i] = ps_latnode_iter_node(itor);
+    }
+
+    /** best path to every node by id: its score, last link, and the slot of the pivot nodes */
+    float64* score = (float64*) malloc((max_id + 1) * sizeof(float64));
+    ps_latlink_t** back = (ps_latlink_t**) calloc(max_id + 1, sizeof(ps_latlink_t*));
+    char* reached = (char*) calloc(max_id + 1, sizeof(char));
+    int* slot_of = (int*) malloc((max_id + 1) * sizeof(int));
+    node_set_t** ns_of = (node_set_t**) calloc(max_id + 1, sizeof(node_set_t*));
+    for (i = 0; i <= max_id; i++) {
+        slot_of[i] = -1;
+    }
+    reached[ps_latnode_get_id(node_stack[n_node-1])] = 1;
+    score[ps_latnode_get_id(node_stack[n_node-1])] = 0;
+    last = node_stack[n_node-1];
+    /** the only walk over the links, kept for aligning them once the pivot is known */
+    for (i = n_node - 2; i >= 0; i--) {
+        id = ps_latnode_get_id(node_stack[i]);
+        for (litor = ps_latnode_entries(node_stack[i]); litor; litor = ps_latlink_iter_next(litor)) {
+            link = ps_latlink_iter_link(litor);
+            if (n_link == n_link_alloc) {
+                n_link_alloc = n_link_alloc ? n_link_alloc * 2 : 256;
+                links = (ps_latlink_t**) realloc(links, n_link_alloc * sizeof(ps_latlink_t*));
+            }
+            links[n_link++] = link;
+            ps_latlink_nodes(link, &from);
+            if (!reached[ps_latnode_get_id(from)])
+                continue;
+            if (!reached[id] || score[ps_latnode_get_id(from)] + ps_latlink_prob(dag, link, NULL) > score[id]) {
+                score[id] = score[ps_latnode_get_id(from)] + ps_latlink_prob(dag, link, NULL);
+                back[id] = link;
+                reached[id] = 1;
+            }
+        }
+        /** the pivot ends at the final node, or at the latest node reached if it is cut off */
+        if (reached[id] && ps_latnode_times(node_stack[i], NULL, NULL) > ps_latnode_times(last, NULL, NULL))
+            last = node_stack[i];
+    }
+    if (reached[ps_latnode_get_id(node_stack[0])])
+        last = node_stack[0];
+
+    /** the pivot links, **bound** are the first frames of its slots and the end of the last one */
+    n_slot = 0;
+    for (node = last; back[ps_latnode_get_id(node)]; ps_latlink_nodes(back[ps_latnode_get_id(node)], &node)) {
+        n_slot++;
+    }
+    ps_latlink_t** pivot = (ps_latlink_t**) malloc((n_slot + 1) * sizeof(ps_latlink_t*));
+    int* bound = (int*) malloc((n_slot + 1) * sizeof(int));
+    node = last;
+    slot_of[ps_latnode_get_id(node)] = n_slot;
+    for (j = n_slot - 1; j >= 0; j--) {
+        pivot[j] = back[ps_latnode_get_id(node)];
+        ps_latlink_nodes(pivot[j], &node);
+        slot_of[ps_latnode_get_id(node)] = j;
+    }
+    bound[0] = 0;
+    for (j = 0; j < n_slot; j++) {
+        ef = ps_latlink_times(pivot[j], &sf);
+        bound[j] = sf;
+        bound[j+1] = ef + 1;
+    }
+
+    arena_t* arena = arena_init(SAUSAGE_ARENA_BLOCK);
+    sausage_t* sausage = (sausage_t*) arena_alloc(arena, sizeof(sausage_t));
+    sausage->arena = arena;
+    sausage->n_nodeset = n_slot + 1;
+    node_set_t** slots = (node_set_t**) malloc((n_slot + 1) * sizeof(node_set_t*));
+    slots[0] = sausage->nodesets = node_set_append(NULL, 0, arena);
+    for (j = 1; j <= n_slot; j++) {
+        slots[j] = node_set_append(slots[j-1], j, arena);
+    }
+    slots[0]->initial = 1;
+    slots[n_slot]->final = 1;
+
+    for (i = n_node - 1; i >= 0; i--) {
+        node = node_stack[i];
+        id = ps_latnode_get_id(node);
+        /** a node off the pivot joins the node set of the nearest slot boundary */
+        if ( (j = slot_of[id]) < 0) {
+            int t = ps_latnode_times(node, NULL, NULL);
+            for (lo = 0, hi = n_slot; lo < hi; ) {
+                int mid = (lo + hi + 1) / 2;
+                if (bound[mid] <= t)
+                    lo = mid;
+                else
+                    hi = mid - 1;
+            }
+            j = (lo < n_slot && bound[lo+1] - t < t - bound[lo]) ? lo + 1 : lo;
+        }
+        node_set_add(slots[j], node, ns_of, arena);
+    }
+
+    for (i = 0; i < n_link && n_slot > 0; i++) {
+        link = links[i];
+        id = ps_latnode_get_id(ps_latlink_nodes(link, NULL));
+        if (slot_of[id] > 0 && link == pivot[slot_of[id] - 1]) {
+            edge_set_add(slots[slot_of[id] - 1]->exit, link, arena);
+            continue;
+        }
+        ef = ps_latlink_times(link, &sf);
+        /** the first slot ending after **sf**, then the one of largest overlap from there */
+        for (lo = 0, hi = n_slot - 1; lo < hi; ) {
+            int mid = (lo + hi) / 2;
+            if (bound[mid+1] > sf)
+                hi = mid;
+            else
+                lo = mid + 1;
+        }
+        best = lo;
+        best_ov = 0;
+        for (j = lo; j < n_slot && bound[j] < ef + 1; j++) {
+            ov = ((ef + 1 < bound[j+1]) ? ef + 1 : bound[j+1]) - ((sf > bound[j]) ? sf : bound[j]);
+            if (ov > best_ov) {
+                best_ov = ov;
+                best = j;
+            }
+        }
+        edge_set_add(slots[best]->exit, link, arena);
+    }
+
+    free(links);
+    free(slots);
+    free(bound);
+    free(pivot);
+    free(ns_of);
+    free(slot_of);
+    free(reached);
+    free(back);
+    free(score);
     free(node_stack);
     return sausage;
 }
 
+sausage_t* sausage_build(ps_lattice_t* dag, sausage_builder_t builder, sim_table_t* sim)
+{
+    if (builder == SAUSAGE_BUILDER_PIVOT)
+        return convert_lattice_to_sausage_pivot(dag);
+    return convert_lattice_to_sausage(dag, sim);
+}
+
 void sausage_last_node_set(sausage_t* s, ps_lattice_t* dag)
 {
     node_set_t* ns;
@@ -414,154 +727,154 @@ void sausage_free(sausage_t* s)
 {
     if (!s)
         return;
-    node_t* n;
-    edge_t* e;
-    node_set_t* ns;
-    edge_set_t* es;
-    while (s->nodesets) {
-        ns = s->nodesets;
-        s->nodesets = s->nodesets->next;
-        
-        es = ns->exit;
-        if (es) {
-            while (es->edges) {
-                e = es->edges;
-                es->edges = es->edges->next;
-                free(e);
-                es->n_edge--;
-            }
-            free(es);
-        }
-        
-        while(ns->nodes) {
-            n = ns->nodes;
-            ns->nodes = ns->nodes->next;
-            free(n);
-            ns->n_node--;
-        }
-        free(ns);
-        s->n_nodeset--;
-    }
-    free(s);
+    /** the sausage lives in its own arena */
+    arena_free(s->arena);
 }
 
-struct lite_node_s {
-  int id;  
-  struct lite_edge_set_s *edge_set; 
-};
-
-struct lite_edge_set_s {
-    int n_edge;
-    lite_edge_t* edges;
-    lite_edge_t* last_edge;
-};
-
-struct lite_edge_s {
-    char* word;  /** WORD */
-    int32 post; /**posterior likelihood*/
-    struct lite_edge_s* next;
-};
-
-
+/**
+ * A simplified sausage in compressed sparse rows: the words of slot i and their posteriors are
+ * wid[off[i]] .. wid[off[i+1]-1] and the same range of post, in the order they were first met.
+ */
 struct lite_sausage_s {
-    int n_node;
-    lite_node_t* nodes;
+    int n_node;         /** number of slots, the position of a slot is its rank */
+    int n_edge;
+    int32* off;         /** n_node + 1 offsets */
+    int32* wid;
+    int32* post;        /** posterior likelihood */
+    vocab_t* vocab;     /** the words are wids of **vocab** */
+    arena_t* arena;     /** the lite sausage and its arrays */
 };
 
 
-void lite_edge_set_add(lite_edge_set_t* lite_es, edge_t* e, ps_lattice_t* dag)
+/**
+ * Add the posterior of **link** to the slot being filled, the last one of the arrays.
+ * **rank** gives the place of each word in the slot, -1 if it is not there yet.
+ */
+static void lite_sausage_add_link(lite_sausage_t* lite_s, int32* rank, ps_latlink_t* link, ps_lattice_t* dag)
 {
-    if (!lite_es || !e) {
-        perror("Err: Bad lite_es or e in function lite_edge_set_add()");
+    int32 wid = vocab_wid(lite_s->vocab, ps_latlink_word(dag, link));
+    int32 k;
+    if (wid < 0)    /** e.g. <s> or fillers, the index has no use for them */
         return;
-    }
-    ps_latlink_t* link = e->edge;
-    const char* word = ps_latlink_word(dag, link);
-    lite_edge_t* lite_e;
-    for (lite_e = lite_es->edges; lite_e; lite_e = lite_e->next) {
-        if ( strncmp(lite_e->word, word, strlen(word)) == 0) {
-            break;
-        }
-    }
-    if (!lite_e) {
-        lite_edge_t* lite_edge;
-        lite_edge = (lite_edge_t*) malloc(sizeof(lite_edge_t));
-        lite_edge->word = (char*) calloc(WORD_MAX_LENGTH + 1, sizeof(char));
-        strncpy(lite_edge->word, word, strlen(word));
-        lite_edge->post = ps_latlink_prob(dag, link, NULL);
-        lite_edge->next = NULL;
-        
-        if (!lite_es->edges) {
-            lite_es->edges = lite_edge;
-        } else {
-            lite_es->last_edge->next = lite_edge;
-        }
-        lite_es->last_edge = lite_edge;
-        lite_es->n_edge++;
-            
+    if ( (k = rank[wid]) < 0) {
+        k = rank[wid] = lite_s->n_edge++;
+        lite_s->wid[k] = wid;
+        lite_s->post[k] = ps_latlink_prob(dag, link, NULL);
     } else {
-        lite_e->post = logmath_add(ps_lattice_get_logmath(dag), lite_e->post, ps_latlink_prob(dag, link, NULL) ); 
-		if (lite_e->post > 0) 
-			lite_e->post = 0;
+        lite_s->post[k] = logmath_add(ps_lattice_get_logmath(dag), lite_s->post[k], ps_latlink_prob(dag, link, NULL) ); 
+		if (lite_s->post[k] > 0) 
+			lite_s->post[k] = 0;
     }
-    
 }
 
 
 
-lite_sausage_t* sausage_simplify(sausage_t* s, ps_lattice_t* dag)
+lite_sausage_t* sausage_simplify(sausage_t* s, ps_lattice_t* dag, vocab_t* vocab)
 {
-    if (!s || !(s->n_nodeset > 0)) { 
+    if (!s || !(s->n_nodeset > 0) || !vocab) { 
         return NULL;
     }
     
     int n_node = s->n_nodeset;
-    lite_sausage_t* lite_s = (lite_sausage_t*) malloc( sizeof(lite_sausage_t) );
-    lite_s->n_node = n_node;    
-    lite_s->nodes = (lite_node_t*) calloc( n_node, sizeof(lite_node_t) );
-    
-    int i;
+    int n_edge = 0;
+    int i, k;
     node_set_t* ns;
-    edge_set_t* es;
     edge_t* e;
+    for (ns = s->nodesets; ns; ns = ns->next) {
+        if (ns->exit)
+            n_edge += ns->exit->n_edge;
+    }
+    
+    arena_t* arena = arena_init(SAUSAGE_ARENA_BLOCK);
+    lite_sausage_t* lite_s = (lite_sausage_t*) arena_alloc(arena, sizeof(lite_sausage_t) );
+    lite_s->arena = arena;
+    lite_s->vocab = vocab_retain(vocab);
+    lite_s->n_node = n_node;    
+    lite_s->n_edge = 0;
+    lite_s->off = (int32*) arena_alloc(arena, (n_node + 1) * sizeof(int32));
+    lite_s->wid = (int32*) arena_alloc(arena, (n_edge + 1) * sizeof(int32));
+    lite_s->post = (int32*) arena_alloc(arena, (n_edge + 1) * sizeof(int32));
+    
+    /** slot rank of each word, only the words of the current slot are set */
+    arena_t* scratch = arena_thread_acquire();
+    int32* rank = (int32*) arena_alloc(scratch, vocab_size(vocab) * sizeof(int32));
+    memset(rank, 0xff, vocab_size(vocab) * sizeof(int32));
     for (i = 0, ns = s->nodesets; i < n_node && ns; i++, ns = ns->next) {
-        lite_s->nodes[i].id = ns->ns_id;
-        lite_s->nodes[i].edge_set = NULL;
+        lite_s->off[i] = lite_s->n_edge;
         if (ns->exit) {
-            es = ns->exit;
-            lite_s->nodes[i].edge_set = (lite_edge_set_t*) malloc( sizeof(lite_edge_set_t) );
-            lite_s->nodes[i].edge_set->n_edge = 0;
-            lite_s->nodes[i].edge_set->edges = lite_s->nodes[i].edge_set->last_edge = NULL;
-            for (e = es->edges; e; e = e->next) {
-                lite_edge_set_add(lite_s->nodes[i].edge_set, e, dag);
+            for (e = ns->exit->edges; e; e = e->next) {
+                lite_sausage_add_link(lite_s, rank, e->edge, dag);
             }
         }        
+        for (k = lite_s->off[i]; k < lite_s->n_edge; k++) {
+            rank[lite_s->wid[k]] = -1;
+        }
     }
+    for (; i <= n_node; i++) {
+        lite_s->off[i] = lite_s->n_edge;
+    }
+    arena_thread_release(scratch);
     return lite_s;      
 }
 
+lite_sausage_t* lite_sausage_init(vocab_t* vocab, int n_slot, const int32* off, const int32* wid, const int32* post)
+{
+    if (!vocab || n_slot <= 0 || off[0] != 0 || off[n_slot] < 0) {
+        perror("lite_sausage_init: bad slots");
+        return NULL;
+    }
+    int n_edge = off[n_slot];
+    arena_t* arena = arena_init(SAUSAGE_ARENA_BLOCK);
+    lite_sausage_t* lite_s = (lite_sausage_t*) arena_alloc(arena, sizeof(lite_sausage_t) );
+    lite_s->arena = arena;
+    lite_s->vocab = vocab_retain(vocab);
+    lite_s->n_node = n_slot;
+    lite_s->n_edge = n_edge;
+    lite_s->off = (int32*) arena_alloc(arena, (n_slot + 1) * sizeof(int32));
+    lite_s->wid = (int32*) arena_alloc(arena, (n_edge + 1) * sizeof(int32));
+    lite_s->post = (int32*) arena_alloc(arena, (n_edge + 1) * sizeof(int32));
+    memcpy(lite_s->off, off, (n_slot + 1) * sizeof(int32));
+    memcpy(lite_s->wid, wid, n_edge * sizeof(int32));
+    memcpy(lite_s->post, post, n_edge * sizeof(int32));
+    return lite_s;
+}
+
+int lite_sausage_n_slot(lite_sausage_t* lite_s)
+{
+    return lite_s->n_node;
+}
+
+int lite_sausage_slot(lite_sausage_t* lite_s, int slot, const int32** wid, const int32** post)
+{
+    if (slot < 0 || slot >= lite_s->n_node)
+        return -1;
+    *wid = lite_s->wid + lite_s->off[slot];
+    *post = lite_s->post + lite_s->off[slot];
+    return lite_s->off[slot + 1] - lite_s->off[slot];
+}
+
+vocab_t* lite_sausage_get_vocab(lite_sausage_t* lite_s)
+{
+    return lite_s->vocab;
+}
+
 void lite_sausage_write(lite_sausage_t* lite_s, const char* filename)
 {
     FILE* fp;
+    if(!lite_s || !(lite_s->n_node >0)) {
+        perror("Bad lite_s");
+        return;
+    }
     if ((fp = fopen(filename, "w")) == NULL) {
         perror("Failed to open file to dump sausage");
         return;
     }
     
-    if(!lite_s || !(lite_s->n_node >0)) {
-        perror("Bad lite_s");
-        return;
-    }
-    int i;
-    lite_node_t* node;
-    lite_edge_t* edge;
+    int i, k;
     for (i = 0; i < lite_s->n_node; i++) {
-        node = &(lite_s->nodes[i]);
-        fprintf(fp, "Node %d\n", node->id);
-        if (node->edge_set) {
-            for (edge = node->edge_set->edges; edge; edge = edge->next) {
-                fprintf(fp, "(%s, %d)\n", edge->word, edge->post);
-            }
+        fprintf(fp, "Node %d\n", i);
+        for (k = lite_s->off[i]; k < lite_s->off[i+1]; k++) {
+            fprintf(fp, "(%s, %d)\n", vocab_word(lite_s->vocab, lite_s->wid[k]), lite_s->post[k]);
         }
     }
     
@@ -572,28 +885,13 @@ void lite_sausage_free(lite_sausage_t* lite_s)
 {
     if (!lite_s)
         return;
-        
-    int i;
-    lite_node_t* node;
-    lite_edge_t* edge;
-    for (i = 0; i < lite_s->n_node; i++) {
-        node = &(lite_s->nodes[i]);  
-        if (node->edge_set) {
-            while (node->edge_set->edges) {
-                edge = node->edge_set->edges;
-                node->edge_set->edges = node->edge_set->edges->next;
-                free(edge->word);
-                free(edge);
-                node->edge_set->n_edge--;
-            }
-        }
-    }
-    free(lite_s);
+    vocab_free(lite_s->vocab);
+    arena_free(lite_s->arena);
 }
 
 
 struct s_hit_s {
-    char* uttid;    /** utterance id*/
+    int32 utt;      /** utterance ordinal in the index's uttdict */
     int32 post;     /** posterior likelihood */
     struct s_hit_s* next;
 };
@@ -602,6 +900,7 @@ struct s_hit_s {
 struct s_hits_pos_s {
 	int pos;
     int n_hit;
+    int unsorted;       /** set when a hit was appended out of utterance order */
     s_hit_t* first;
     s_hit_t* last;
     struct s_hits_pos_s* next;
@@ -609,16 +908,84 @@ struct s_hits_pos_s {
 
 struct s_hits_word_s {
     int n_pos;
+    int unsorted;       /** some position of the word is unsorted */
     s_hits_pos_t* first;
     s_hits_pos_t* last;
 };
 
+/**
+ * Binary dual-clue index layout, all sections 4-byte aligned and in host byte order; offsets
+ * are 64-bit so that an archive may grow past 4 GiB:
+ *
+ *   d_bin_header_t
+ *   d_bin_word_t  [n_word]   word name plus the range of its positions
+ *   d_bin_pos_t   [n_pos]    position directory, ascending by pos inside a word
+ *   d_bin_hit_t   [n_hit]    packed hits, grouped by (word, position)
+ *   uttdict       [utts_size]     interned utterance ids, see uttdict_write()
+ *
+ * dualclue_index_read_bin() maps the file and searches the sections in place.
+ */
+typedef struct d_bin_header_s {
+    char magic[8];
+    uint32 version;
+    uint32 n_word;
+    uint32 n_pos;
+    uint32 n_hit;
+    uint32 utts_size;
+    uint32 reserved;
+    uint64_t word_off;
+    uint64_t pos_off;
+    uint64_t hits_off;
+    uint64_t utts_off;
+} d_bin_header_t;
+
+typedef struct d_bin_word_s {
+    char word[WORD_MAX_LENGTH + 1];
+    uint32 first_pos;   /** index of the first directory entry of this word */
+    uint32 n_pos;
+} d_bin_word_t;
+
+typedef struct d_bin_pos_s {
+    int32 pos;
+    uint32 first_hit;   /** index of the first hit at this position */
+    uint32 n_hit;
+} d_bin_pos_t;
+
+typedef struct d_bin_hit_s {
+    int32 utt;      /** utterance ordinal */
+    int32 post;
+} d_bin_hit_t;
+
 struct dualclue_index_s {
     int n_word;
-    char** word_list;
+    vocab_t* vocab;     /** word list, may be shared with other indexes */
     s_hits_word_t* s_hits;
+    uttdict_t* utts;    /** utterance ids referred to by the hits */
+    sausage_builder_t builder;  /** how sausages are built for this index */
+    
+    /* read-only postings of a mapped binary index, searched along with s_hits */
+    void* map;
+    size_t map_size;
+    const d_bin_word_t* map_words;
+    const d_bin_pos_t* map_pos;
+    const d_bin_hit_t* map_hits;
+    
+    /** taken by dualclue_index_publish(), a stripe per word; the dictionary has its own lock */
+    pthread_mutex_t stripes[N_STRIPE];
 };
 
+/**
+ * s_hit_iter_t
+ * Walks the hits of one (word, position), first the mapped ones then the heap
+ * list. Mapped hits are unpacked into **scratch**, valid until the next call.
+ */
+typedef struct s_hit_iter_s {
+    dualclue_index_t* index;
+    const d_bin_hit_t *cur, *end;
+    s_hit_t* next_hit;
+    s_hit_t scratch;
+} s_hit_iter_t;
+
 s_hits_pos_t* s_hits_word_get_pos(s_hits_word_t* hits_word, int pos)
 {
 	s_hits_pos_t* hits_pos;
@@ -630,150 +997,395 @@ s_hits_pos_t* s_hits_word_get_pos(s_hits_word_t* hits_word, int pos)
 	return NULL;
 }
 
-dualclue_index_t* dualclue_index_init(const char* filename)
+/** Directory entry of position **pos** of word **wid** in the mapped index, NULL if none */
+const d_bin_pos_t* dualclue_index_map_get_pos(dualclue_index_t* index, int wid, int pos)
 {
-    int i;
-    FILE* fp;
-    char s[WORD_MAX_LENGTH + 2] = {'\0',};
-    if ( (fp = fopen(filename, "r")) == NULL ) {
-        perror("Failed to open file to initialize dualclue index");
+    if (!index->map) {
         return NULL;
     }
-    dualclue_index_t* index = (dualclue_index_t*) malloc( sizeof(dualclue_index_t) );
-    index->n_word = 0;
-    index->word_list = NULL;
-    index->s_hits = NULL;
-    
-    while ( fgets(s, WORD_MAX_LENGTH + 2, fp) != '\0') {
-        index->n_word++;
+    const d_bin_pos_t* dir = index->map_pos + index->map_words[wid].first_pos;
+    uint32 lo = 0, hi = index->map_words[wid].n_pos, mid;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (dir[mid].pos < pos) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
     }
-    index->word_list = (char**) malloc(index->n_word * sizeof(char*));
-    for (i = 0; i < index->n_word; i++) {
-        index->word_list[i] = (char*) malloc( (WORD_MAX_LENGTH + 1) * sizeof(char));
-        memset(index->word_list[i], 0, (WORD_MAX_LENGTH + 1) * sizeof(char));
+    if (lo < index->map_words[wid].n_pos && dir[lo].pos == pos) {
+        return &(dir[lo]);
+    }
+    return NULL;
+}
+
+s_hit_t* s_hit_iter_next(s_hit_iter_t* it)
+{
+    s_hit_t* hit;
+    if (it->cur < it->end) {
+        hit = &(it->scratch);
+        hit->utt = it->cur->utt;
+        hit->post = it->cur->post;
+        hit->next = NULL;
+        it->cur++;
+        return hit;
     }
-    fseek(fp, 0, SEEK_SET);
-    i = 0;
-    while ((fgets(s, WORD_MAX_LENGTH + 2, fp) != '\0')) {
-        strncpy(index->word_list[i], strtok(s, "\n"), WORD_MAX_LENGTH);
-	    //printf("%s", index->word_list[i]);	    
-	    i++;
+    hit = it->next_hit;
+    if (hit) {
+        it->next_hit = hit->next;
     }
-    fclose(fp);
-    
-    index->s_hits = (s_hits_word_t*) calloc(index->n_word, sizeof(s_hits_word_t));
-    return index;
+    return hit;
 }
 
-int dualclue_index_get_wid(dualclue_index_t* index, const char* word)
+/** Position the iterator on the first hit of word **wid** at position **pos** and return it */
+s_hit_t* s_hit_iter_init(s_hit_iter_t* it, dualclue_index_t* index, int wid, int pos)
 {
-    int i;
-    int len = strlen(word);
-    
-    for (i = 0; i < index->n_word; i++) {
-        if ( len == strlen(index->word_list[i]) 
-            && strncmp(word, index->word_list[i], len ) == 0 ) 
-            break;
+    const d_bin_pos_t* dir = dualclue_index_map_get_pos(index, wid, pos);
+    s_hits_pos_t* hits_pos = s_hits_word_get_pos(&(index->s_hits[wid]), pos);
+    it->index = index;
+    it->cur = it->end = NULL;
+    if (dir) {
+        it->cur = index->map_hits + dir->first_hit;
+        it->end = it->cur + dir->n_hit;
     }
-    
-    if ( i < index->n_word ) 
-        return i;
-    else
-        return -1; /**  **word** not found in the word_list */
+    it->next_hit = hits_pos ? hits_pos->first : NULL;
+    return s_hit_iter_next(it);
 }
 
-void dualclue_index_addhit(dualclue_index_t* index, const char* uttid, lite_sausage_t* lite_s)
+int int_cmp(const void* a, const void* b)
 {
-    if (!index) {
-        perror("dualclue_index_addhit: Bad index");
-        return;
+    int x = *(const int*) a, y = *(const int*) b;
+    return (x > y) - (x < y);
+}
+
+/** Upper bound of the number of positions of **wid**, mapped and in memory */
+static int dualclue_index_max_positions(dualclue_index_t* index, int wid)
+{
+    return (index->map ? index->map_words[wid].n_pos : 0) + index->s_hits[wid].n_pos;
+}
+
+/** Store the sorted positions of **wid** in **positions**, returns their number */
+static int dualclue_index_fill_positions(dualclue_index_t* index, int wid, int* positions)
+{
+    int n = 0, i, k;
+    s_hits_pos_t* hits_pos;
+    int n_map = index->map ? index->map_words[wid].n_pos : 0;
+    
+    for (i = 0; i < n_map; i++) {
+        positions[n++] = index->map_pos[index->map_words[wid].first_pos + i].pos;
     }
-    if(!lite_s || !(lite_s->n_node >0)) {
-        perror("dualclue_index_addhit: Bad lite_s");
-        return;
+    for (hits_pos = index->s_hits[wid].first; hits_pos; hits_pos = hits_pos->next) {
+        positions[n++] = hits_pos->pos;
     }
-    int i;
-    int wid, pos;
-    lite_node_t* node;
-    lite_edge_t* edge;
-	s_hits_pos_t* hits_pos;
-    for (i = 0; i < lite_s->n_node; i++) {
-        node = &(lite_s->nodes[i]);
-        pos = node->id;
-        if (node->edge_set) {
-            for (edge = node->edge_set->edges; edge; edge = edge->next) {
-                wid = dualclue_index_get_wid(index, edge->word);
-                if (wid == -1) { /** skip incorrect word */
-                    continue;
-                }   
-                /**looking for pointer which points to the position of the word , */
-                if (index->s_hits[wid].n_pos == 0) { /** no hits in this word right now, 
-					also means there's not any position information inside the word,
-					so create the first position information */
-					hits_pos = (s_hits_pos_t*) calloc(1, sizeof(s_hits_pos_t));
-					hits_pos->pos = pos;
-					index->s_hits[wid].n_pos++;
-					index->s_hits[wid].first = index->s_hits[wid].last = hits_pos;
-				}else { /** look for the wanted position pointer among existing position information*/
-					hits_pos = s_hits_word_get_pos(&(index->s_hits[wid]), pos);
-					if (NULL == hits_pos){ /** current position is not found among existing position information*/
-						hits_pos = (s_hits_pos_t*) calloc(1, sizeof(s_hits_pos_t));
-						hits_pos->pos = pos;
-						index->s_hits[wid].n_pos++;
-						index->s_hits[wid].last->next = hits_pos;
-						index->s_hits[wid].last = hits_pos;
-					} 
-				}
-				/**Found pointer **hits_pos** which points to the position of the word , then add hit to that position */
-				s_hit_t* hit;
-				hit = (s_hit_t*) calloc(1, sizeof(s_hit_t));
-				hit->uttid = (char*) calloc(strlen(uttid)+1, sizeof(char));
-				strncpy(hit->uttid, uttid, strlen(uttid));
-				hit->post = edge->post;
-				if (hits_pos->n_hit == 0) {
-					hits_pos->first = hit;
-				} else {
-					hits_pos->last->next = hit;
-				}
-				hits_pos->last = hit;
-				hits_pos->n_hit++;
-            }
+    qsort(positions, n, sizeof(int), int_cmp);
+    for (i = k = 0; i < n; i++) {
+        if (k == 0 || positions[k-1] != positions[i]) {
+            positions[k++] = positions[i];
         }
     }
+    return k;
 }
 
-void dualclue_index_free(dualclue_index_t* index)
+int dualclue_index_get_positions(dualclue_index_t* index, int wid, int** positions)
 {
-	if(!index) {
-		return;
-	}
-	int i;
-	s_hits_word_t* hits_word;
-	s_hits_pos_t* hits_pos;
-	s_hit_t* hit;
-	for (i = 0; i < index->n_word; i++) {
-		hits_word = &(index->s_hits[i]);
-		/* == free hits inside this word ==*/
-		while (hits_word->first) {
-			hits_pos = hits_word->first;
-			hits_word->first = hits_word->first->next;
-			/* == free hits inside this position ==*/
-			while (hits_pos->first) {
-				hit = hits_pos->first;
-				hits_pos->first = hits_pos->first->next;
-				free(hit->uttid);
-				free(hit);
-				hits_pos->n_hit--;			
-			}			
-			free(hits_pos);
-			hits_word->n_pos--;			
-		}
-	}
+    *positions = (int*) malloc((dualclue_index_max_positions(index, wid) + 1) * sizeof(int));
+    return dualclue_index_fill_positions(index, wid, *positions);
+}
+
+/** Allocate an empty index over **n_word** words, taking over the reference to **vocab** */
+static dualclue_index_t* dualclue_index_alloc(vocab_t* vocab, int n_word)
+{
+    int i;
+    dualclue_index_t* index = (dualclue_index_t*) malloc( sizeof(dualclue_index_t) );
+    index->n_word = n_word;
+    index->vocab = vocab;
+    index->s_hits = (s_hits_word_t*) calloc(index->n_word, sizeof(s_hits_word_t));
+    index->utts = uttdict_init();
+    index->builder = SAUSAGE_BUILDER_IMPROVED;
+    index->map = NULL;
+    for (i = 0; i < N_STRIPE; i++) {
+        pthread_mutex_init(&(index->stripes[i]), NULL);
+    }
+    return index;
+}
+
+dualclue_index_t* dualclue_index_init_vocab(vocab_t* vocab)
+{
+    if (!vocab)
+        return NULL;
+    return dualclue_index_alloc(vocab_retain(vocab), vocab_size(vocab));
+}
+
+dualclue_index_t* dualclue_index_init(const char* filename)
+{
+    vocab_t* vocab = vocab_read(filename);
+    if (!vocab) {
+        perror("Failed to open file to initialize dualclue index");
+        return NULL;
+    }
+    dualclue_index_t* index = dualclue_index_init_vocab(vocab);
+    vocab_free(vocab);
+    return index;
+}
+
+uttdict_t* dualclue_index_get_uttdict(dualclue_index_t* index)
+{
+	return index->utts;
+}
+
+int dualclue_index_set_uttdict(dualclue_index_t* index, uttdict_t* utts)
+{
+	int i;
+	if (index->map) {
+		return -1;
+	}
 	for (i = 0; i < index->n_word; i++) {
-		free(index->word_list[i]);
+		if (index->s_hits[i].n_pos > 0)
+			return -1;  /** ordinals of existing hits belong to the old dictionary */
 	}
-	free(index->word_list);
+	uttdict_free(index->utts);
+	index->utts = uttdict_retain(utts);
+	return 0;
+}
+
+int dualclue_index_get_wid(dualclue_index_t* index, const char* word)
+{
+    return vocab_wid(index->vocab, word); /**  -1 if **word** not found in the word_list */
+}
+
+vocab_t* dualclue_index_get_vocab(dualclue_index_t* index)
+{
+    return index->vocab;
+}
+
+void dualclue_index_set_builder(dualclue_index_t* index, sausage_builder_t builder)
+{
+    index->builder = builder;
+}
+
+sausage_builder_t dualclue_index_get_builder(dualclue_index_t* index)
+{
+    return index->builder;
+}
+
+/**
+ * Add a hit of word **wid** at position **pos**. Hits are appended; one older than the last
+ * marks the position unsorted, it is sorted once before the hits are read in order.
+ */
+static void dualclue_index_add_one(dualclue_index_t* index, int wid, int pos, int32 utt, int32 post)
+{
+	s_hits_pos_t* hits_pos;
+	/**looking for pointer which points to the position of the word , */
+	if (index->s_hits[wid].n_pos == 0) { /** no hits in this word right now, 
+		also means there's not any position information inside the word,
+		so create the first position information */
+		hits_pos = (s_hits_pos_t*) calloc(1, sizeof(s_hits_pos_t));
+		hits_pos->pos = pos;
+		index->s_hits[wid].n_pos++;
+		index->s_hits[wid].first = index->s_hits[wid].last = hits_pos;
+	}else { /** look for the wanted position pointer among existing position information*/
+		hits_pos = s_hits_word_get_pos(&(index->s_hits[wid]), pos);
+		if (NULL == hits_pos){ /** current position is not found among existing position information*/
+			hits_pos = (s_hits_pos_t*) calloc(1, sizeof(s_hits_pos_t));
+			hits_pos->pos = pos;
+			index->s_hits[wid].n_pos++;
+			index->s_hits[wid].last->next = hits_pos;
+			index->s_hits[wid].last = hits_pos;
+		} 
+	}
+	/**Found pointer **hits_pos** which points to the position of the word , then add hit to that position */
+	s_hit_t* hit;
+	hit = (s_hit_t*) calloc(1, sizeof(s_hit_t));
+	hit->utt = utt;
+	hit->post = post;
+	if (hits_pos->n_hit == 0) {
+		hits_pos->first = hits_pos->last = hit;
+	} else {
+		if (utt < hits_pos->last->utt) {
+			hits_pos->unsorted = 1;
+			index->s_hits[wid].unsorted = 1;
+		}
+		hits_pos->last->next = hit;
+		hits_pos->last = hit;
+	}
+	hits_pos->n_hit++;
+}
+
+/** Stable merge sort of the **n** hits of a list by utterance, returns the new head */
+static s_hit_t* s_hit_list_sort(s_hit_t* head, int n)
+{
+	s_hit_t *a, *b, *tail, **link;
+	s_hit_t merged;
+	int i;
+	if (n < 2)
+		return head;
+	for (i = 1, tail = head; i < n / 2; i++)
+		tail = tail->next;
+	b = tail->next;
+	tail->next = NULL;
+	a = s_hit_list_sort(head, n / 2);
+	b = s_hit_list_sort(b, n - n / 2);
+	/** ties keep the hit of **a**, the one appended first */
+	for (link = &(merged.next); a && b; link = &((*link)->next)) {
+		if (b->utt < a->utt) {
+			*link = b;
+			b = b->next;
+		} else {
+			*link = a;
+			a = a->next;
+		}
+	}
+	*link = a ? a : b;
+	return merged.next;
+}
+
+/** Sort the unsorted positions of word **wid** */
+static void dualclue_index_sort_word(dualclue_index_t* index, int wid)
+{
+	s_hits_pos_t* hits_pos;
+	s_hit_t* hit;
+	if (!index->s_hits[wid].unsorted)
+		return;
+	for (hits_pos = index->s_hits[wid].first; hits_pos; hits_pos = hits_pos->next) {
+		if (!hits_pos->unsorted)
+			continue;
+		hits_pos->first = s_hit_list_sort(hits_pos->first, hits_pos->n_hit);
+		for (hit = hits_pos->first; hit->next; hit = hit->next)
+			;
+		hits_pos->last = hit;
+		hits_pos->unsorted = 0;
+	}
+	index->s_hits[wid].unsorted = 0;
+}
+
+void dualclue_index_freeze(dualclue_index_t* index)
+{
+	int i;
+	for (i = 0; i < index->n_word; i++) {
+		dualclue_index_sort_word(index, i);
+	}
+}
+
+void dualclue_index_addhit(dualclue_index_t* index, const char* uttid, lite_sausage_t* lite_s)
+{
+    if (!index) {
+        perror("dualclue_index_addhit: Bad index");
+        return;
+    }
+    if(!lite_s || !(lite_s->n_node >0)) {
+        perror("dualclue_index_addhit: Bad lite_s");
+        return;
+    }
+    int pos, k;
+    int wid;
+    int32 utt = uttdict_intern(index->utts, uttid);
+    for (pos = 0; pos < lite_s->n_node; pos++) {
+        for (k = lite_s->off[pos]; k < lite_s->off[pos+1]; k++) {
+            wid = lite_s->wid[k];
+            /** a sausage over another word list is translated word by word */
+            if (lite_s->vocab != index->vocab 
+                    && (wid = dualclue_index_get_wid(index, vocab_word(lite_s->vocab, wid))) == -1) {
+                continue;
+            }   
+            dualclue_index_add_one(index, wid, pos, utt, lite_s->post[k]);
+        }
+    }
+}
+
+int dualclue_index_merge(dualclue_index_t* dst, dualclue_index_t* src)
+{
+	int i, j, n_pos;
+	int* positions;
+	int32* utt_map = NULL;
+	s_hit_iter_t it;
+	s_hit_t* hit;
+	
+	if (dst->n_word != src->n_word) {
+		perror("dualclue_index_merge: different word lists");
+		return -1;
+	}
+	/** ordinals are translated unless both indexes share one dictionary */
+	if (src->utts != dst->utts) {
+		utt_map = uttdict_map(dst->utts, src->utts);
+	}
+	for (i = 0; i < src->n_word; i++) {
+		dualclue_index_sort_word(src, i);
+		n_pos = dualclue_index_get_positions(src, i, &positions);
+		if (n_pos > 0) {
+			pthread_mutex_lock(&(dst->stripes[i % N_STRIPE]));
+			for (j = 0; j < n_pos; j++) {
+				for (hit = s_hit_iter_init(&it, src, i, positions[j]); hit; hit = s_hit_iter_next(&it)) {
+					dualclue_index_add_one(dst, i, positions[j], utt_map ? utt_map[hit->utt] : hit->utt, hit->post);
+				}
+			}
+			pthread_mutex_unlock(&(dst->stripes[i % N_STRIPE]));
+		}
+		free(positions);
+	}
+	free(utt_map);
+	return 0;
+}
+
+dualclue_index_t* dualclue_index_stage_init(dualclue_index_t* index)
+{
+	dualclue_index_t* stage = dualclue_index_init_vocab(index->vocab);
+	stage->builder = index->builder;
+	return stage;
+}
+
+/** Free the heap postings of **index** */
+static void dualclue_index_clear(dualclue_index_t* index)
+{
+	int i;
+	s_hits_word_t* hits_word;
+	s_hits_pos_t* hits_pos;
+	s_hit_t* hit;
+	for (i = 0; i < index->n_word; i++) {
+		hits_word = &(index->s_hits[i]);
+		/* == free hits inside this word ==*/
+		while (hits_word->first) {
+			hits_pos = hits_word->first;
+			hits_word->first = hits_word->first->next;
+			/* == free hits inside this position ==*/
+			while (hits_pos->first) {
+				hit = hits_pos->first;
+				hits_pos->first = hits_pos->first->next;
+				free(hit);
+				hits_pos->n_hit--;			
+			}			
+			free(hits_pos);
+			hits_word->n_pos--;			
+		}
+		hits_word->last = NULL;
+	}
+}
+
+int dualclue_index_publish(dualclue_index_t* index, dualclue_index_t* stage)
+{
+	if (dualclue_index_merge(index, stage) < 0)
+		return -1;
+	dualclue_index_clear(stage);
+	uttdict_free(stage->utts);
+	stage->utts = uttdict_init();
+	return 0;
+}
+
+void dualclue_index_free(dualclue_index_t* index)
+{
+	if(!index) {
+		return;
+	}
+	int i;
+	dualclue_index_clear(index);
+	if (index->map) {
+		munmap(index->map, index->map_size);
+	}
+	uttdict_free(index->utts);
+	vocab_free(index->vocab);
 	free(index->s_hits);
+	for (i = 0; i < N_STRIPE; i++) {
+		pthread_mutex_destroy(&(index->stripes[i]));
+	}
 	free(index);
 }
 
@@ -786,21 +1398,22 @@ void dualclue_index_write(dualclue_index_t* index, const char* filename)
 		return;
 	}
 	
+	dualclue_index_freeze(index);
 	fprintf(fp, "# Words: %d\n", index->n_word);
-    s_hits_word_t* hits_word;
-	s_hits_pos_t* hits_pos;
+	s_hit_iter_t it;
 	s_hit_t* hit;
-	int i;
+	int* positions;
+	int i, j, n_pos;
     for (i = 0; i < index->n_word; i++) {
-		hits_word = &(index->s_hits[i]);
-		fprintf(fp, "WORD#%d %s (%d)\n", i, index->word_list[i], hits_word->n_pos);
-		for (hits_pos = hits_word->first; hits_pos; hits_pos = hits_pos->next) {
-			fprintf(fp, "POS #%d\n", hits_pos->pos);
-			for (hit = hits_pos->first; hit; hit = hit->next) {
-				fprintf(fp, "(%d, %s)\n", hit->post, hit->uttid);
+		n_pos = dualclue_index_get_positions(index, i, &positions);
+		fprintf(fp, "WORD#%d %s (%d)\n", i, vocab_word(index->vocab, i), n_pos);
+		for (j = 0; j < n_pos; j++) {
+			fprintf(fp, "POS #%d\n", positions[j]);
+			for (hit = s_hit_iter_init(&it, index, i, positions[j]); hit; hit = s_hit_iter_next(&it)) {
+				fprintf(fp, "(%d, %s)\n", hit->post, uttdict_str(index->utts, hit->utt));
 			}
 		}
-		
+		free(positions);
     }
 	
 	fclose(fp);
@@ -815,38 +1428,41 @@ dualclue_index_t* dualclue_index_read(const char* filename)
 	}
 	
 	int n_word;
-	if ( 1 != fscanf(fp,"# Words: %d\n", &n_word)) {
+	if ( 1 != fscanf(fp,"# Words: %d\n", &n_word) || n_word < 0) {
 		perror("dualclue_index_read: format error");
+		fclose(fp);
 		return NULL;
 	};
-	dualclue_index_t* index = (dualclue_index_t*) malloc( sizeof(dualclue_index_t) );
-    index->n_word = n_word;
-    index->word_list = NULL;
-    index->s_hits = NULL;
-	/** word list */
-    index->word_list = (char**) calloc(index->n_word, sizeof(char*));
-	/** hits */
-	index->s_hits = (s_hits_word_t*) calloc(index->n_word, sizeof(s_hits_word_t));
+	/** hits; the vocabulary is built once all words are read */
+	dualclue_index_t* index = dualclue_index_alloc(NULL, n_word);
+	char** word_list = (char**) calloc(n_word, sizeof(char*));
 	
-	int i, k;
+	int i = -1, k;
+	int error = 0;
+	s_hits_pos_t* hits_pos = NULL;
 	char line[MAX_LINE_LENGTH] = {'\0',}; 
 	char word[WORD_MAX_LENGTH + 1] = {'\0',};
 	int n_pos, pos;
 	char uttid[MAX_LINE_LENGTH] = {'\0',};
 	int32 post;
-	s_hits_pos_t* hits_pos;
 	while ( NULL != fgets(line, MAX_LINE_LENGTH, fp) ) {
 		if ( (( k = sscanf(line, "WORD#%d %s (%d)\n", &i, word, &n_pos) ) != 3) &&
 				(( k = sscanf(line, "POS #%d\n", &pos) ) != 1) &&
 				(( k = sscanf(line, "(%d, %[^)])\n", &post, uttid) ) != 2) ) {
-			dualclue_index_free(index);
-			return NULL;
+			error = 1;
+			break;
+		}
+		if (i < 0 || i >= n_word || (k == 2 && !hits_pos)) {
+			error = 1;
+			break;
 		}
 		if ( k == 3) { // new word
 			//printf("WORD#%d %s (%d)\n", i, word, n_pos);
-			index->word_list[i] = (char*) calloc(WORD_MAX_LENGTH+1, sizeof(char));
-			strncpy(index->word_list[i], word, strlen(word));
+			free(word_list[i]);
+			word_list[i] = (char*) calloc(WORD_MAX_LENGTH+1, sizeof(char));
+			strncpy(word_list[i], word, WORD_MAX_LENGTH);
 			index->s_hits[i].n_pos = n_pos;			
+			hits_pos = NULL;
 		} 
 		if ( k == 1) { // new position
 			//printf("POS #%d\n", pos);
@@ -864,8 +1480,7 @@ dualclue_index_t* dualclue_index_read(const char* filename)
 		if ( k == 2 ) { // new hit
 			//printf("(%d, %s)\n", post, uttid);
 			s_hit_t* hit = (s_hit_t*) calloc(1, sizeof(s_hit_t));
-			hit->uttid = (char*) calloc(strlen(uttid)+1, sizeof(char));
-			strncpy(hit->uttid, uttid, strlen(uttid));
+			hit->utt = uttdict_intern(index->utts, uttid);
 			hit->post = post;
 			if (!hits_pos->first) {
 				hits_pos->first = hit;
@@ -876,21 +1491,456 @@ dualclue_index_t* dualclue_index_read(const char* filename)
 			hits_pos->n_hit++;
 		} 
 	}
+	fclose(fp);
+	
+	/** words missing from the file become empty, unreachable entries */
+	for (i = 0; i < n_word; i++) {
+		if (!word_list[i])
+			word_list[i] = (char*) calloc(1, sizeof(char));
+	}
+	index->vocab = vocab_init((const char* const*) word_list, n_word);
+	for (i = 0; i < n_word; i++) {
+		free(word_list[i]);
+	}
+	free(word_list);
+	if (error) {
+		dualclue_index_free(index);
+		return NULL;
+	}
+	return index;
+}
+
+int dualclue_index_write_bin(dualclue_index_t* index, const char* filename)
+{
+	FILE* fp;
+	if ( (fp = fopen(filename, "wb")) == NULL) {
+		perror("dualclue_index_write_bin: BAD filename");
+		return -1;
+	}
+	
+	d_bin_header_t header;
+	d_bin_word_t* words = (d_bin_word_t*) calloc(index->n_word, sizeof(d_bin_word_t));
+	d_bin_pos_t* dir = NULL;
+	uint32 dir_alloc = 0;
+	d_bin_hit_t rec;
+	s_hit_iter_t it;
+	s_hit_t* hit;
+	int* positions;
+	int i, j, n_pos;
+	uint32 p;
+	
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, DUALCLUE_BIN_MAGIC, sizeof(header.magic));
+	header.version = DUALCLUE_BIN_VERSION;
+	header.n_word = index->n_word;
+	
+	dualclue_index_freeze(index);
+	/** 1st pass: word table and position directory */
+	for (i = 0; i < index->n_word; i++) {
+		strncpy(words[i].word, vocab_word(index->vocab, i), WORD_MAX_LENGTH);
+		words[i].first_pos = header.n_pos;
+		n_pos = dualclue_index_get_positions(index, i, &positions);
+		for (j = 0; j < n_pos; j++) {
+			if (header.n_pos == dir_alloc) {
+				dir_alloc = dir_alloc ? dir_alloc * 2 : 1024;
+				dir = (d_bin_pos_t*) realloc(dir, dir_alloc * sizeof(d_bin_pos_t));
+			}
+			dir[header.n_pos].pos = positions[j];
+			dir[header.n_pos].first_hit = header.n_hit;
+			dir[header.n_pos].n_hit = 0;
+			for (hit = s_hit_iter_init(&it, index, i, positions[j]); hit; hit = s_hit_iter_next(&it)) {
+				dir[header.n_pos].n_hit++;
+			}
+			header.n_hit += dir[header.n_pos].n_hit;
+			header.n_pos++;
+		}
+		words[i].n_pos = header.n_pos - words[i].first_pos;
+		free(positions);
+	}
+	header.word_off = sizeof(d_bin_header_t);
+	header.pos_off = header.word_off + (uint64_t) index->n_word * sizeof(d_bin_word_t);
+	header.hits_off = header.pos_off + (uint64_t) header.n_pos * sizeof(d_bin_pos_t);
+	header.utts_off = header.hits_off + (uint64_t) header.n_hit * sizeof(d_bin_hit_t);
 	
+	/** 2nd pass: stream the hits */
+	fseeko(fp, (off_t) header.hits_off, SEEK_SET);
+	for (i = 0; i < index->n_word; i++) {
+		for (p = words[i].first_pos; p < words[i].first_pos + words[i].n_pos; p++) {
+			for (hit = s_hit_iter_init(&it, index, i, dir[p].pos); hit; hit = s_hit_iter_next(&it)) {
+				rec.utt = hit->utt;
+				rec.post = hit->post;
+				fwrite(&rec, sizeof(rec), 1, fp);
+			}
+		}
+	}
+	header.utts_size = uttdict_write(index->utts, fp);
+	fseek(fp, 0, SEEK_SET);
+	fwrite(&header, sizeof(header), 1, fp);
+	fwrite(words, sizeof(d_bin_word_t), index->n_word, fp);
+	fwrite(dir, sizeof(d_bin_pos_t), header.n_pos, fp);
+	
+	free(dir);
+	free(words);
+	if (ferror(fp)) {
+		perror("dualclue_index_write_bin: write error");
+		fclose(fp);
+		return -1;
+	}
 	fclose(fp);
+	return 0;
+}
+
+dualclue_index_t* dualclue_index_read_bin(const char* filename)
+{
+	int fd;
+	struct stat st;
+	void* map;
+	if ( (fd = open(filename, O_RDONLY)) < 0) {
+		perror("dualclue_index_read_bin: BAD filename");
+		return NULL;
+	}
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(d_bin_header_t)) {
+		perror("dualclue_index_read_bin: not a binary index");
+		close(fd);
+		return NULL;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		perror("dualclue_index_read_bin: mmap");
+		return NULL;
+	}
+	
+	const d_bin_header_t* header = (const d_bin_header_t*) map;
+	size_t size = st.st_size;
+	if (strncmp(header->magic, DUALCLUE_BIN_MAGIC, sizeof(header->magic)) != 0
+		|| header->version != DUALCLUE_BIN_VERSION
+		|| header->word_off + (uint64_t) header->n_word * sizeof(d_bin_word_t) > size
+		|| header->pos_off + (uint64_t) header->n_pos * sizeof(d_bin_pos_t) > size
+		|| header->hits_off + (uint64_t) header->n_hit * sizeof(d_bin_hit_t) > size
+		|| header->utts_off + header->utts_size > size) {
+		fprintf(stderr, "dualclue_index_read_bin: %s: bad header or version\n", filename);
+		munmap(map, size);
+		return NULL;
+	}
+	uttdict_t* utts = uttdict_read_mem((const char*) map + header->utts_off, header->utts_size);
+	if (!utts) {
+		fprintf(stderr, "dualclue_index_read_bin: %s: bad utterance dictionary\n", filename);
+		munmap(map, size);
+		return NULL;
+	}
+	
+	/** the word table and the position directory are checked here, the hits are left to the OS */
+	const d_bin_word_t* words = (const d_bin_word_t*) ((const char*) map + header->word_off);
+	const d_bin_pos_t* dir = (const d_bin_pos_t*) ((const char*) map + header->pos_off);
+	uint32 i;
+	if (header->word_off % sizeof(int32) != 0
+		|| header->pos_off % sizeof(int32) != 0
+		|| header->hits_off % sizeof(int32) != 0) {
+		fprintf(stderr, "dualclue_index_read_bin: %s: misaligned section\n", filename);
+		uttdict_free(utts);
+		munmap(map, size);
+		return NULL;
+	}
+	for (i = 0; i < header->n_word; i++) {
+		if ( (uint64_t) words[i].first_pos + words[i].n_pos > header->n_pos) {
+			fprintf(stderr, "dualclue_index_read_bin: %s: word %u out of range\n", filename, i);
+			uttdict_free(utts);
+			munmap(map, size);
+			return NULL;
+		}
+	}
+	for (i = 0; i < header->n_pos; i++) {
+		if ( (uint64_t) dir[i].first_hit + dir[i].n_hit > header->n_hit) {
+			fprintf(stderr, "dualclue_index_read_bin: %s: position entry %u out of range\n", filename, i);
+			uttdict_free(utts);
+			munmap(map, size);
+			return NULL;
+		}
+	}
+	
+	/** the word table holds fixed-size, NUL-padded names */
+	const char** word_names = (const char**) malloc((header->n_word + 1) * sizeof(char*));
+	char* names = (char*) calloc(header->n_word + 1, WORD_MAX_LENGTH + 1);
+	for (i = 0; i < header->n_word; i++) {
+		strncpy(names + i * (WORD_MAX_LENGTH + 1), words[i].word, WORD_MAX_LENGTH);
+		word_names[i] = names + i * (WORD_MAX_LENGTH + 1);
+	}
+	vocab_t* vocab = vocab_init(word_names, header->n_word);
+	free(word_names);
+	free(names);
+	if (!vocab) {
+		fprintf(stderr, "dualclue_index_read_bin: %s: bad word table\n", filename);
+		uttdict_free(utts);
+		munmap(map, size);
+		return NULL;
+	}
+	dualclue_index_t* index = dualclue_index_alloc(vocab, header->n_word);
+	uttdict_free(index->utts);
+	index->utts = utts;
+	index->map = map;
+	index->map_size = size;
+	index->map_words = words;
+	index->map_pos = dir;
+	index->map_hits = (const d_bin_hit_t*) ((const char*) map + header->hits_off);
 	return index;
 }
 
+/**
+ * d_merge_input_t
+ * One input of dualclue_index_merge_files(): its tables, a reader of its position directory
+ * and one of the hits at the current position
+ */
+typedef struct d_merge_input_s {
+	FILE* fp;
+	d_bin_header_t header;
+	d_bin_word_t* words;
+	int32* utt_map;		/** ordinals of the input to those of the output */
+	int32 n_utt;
+	bufio_t* dir;
+	bufio_t* hits;
+	const d_bin_pos_t* pos;		/** current directory entry, NULL past the word */
+	const d_bin_hit_t* hit;		/** current hit at the merged position, NULL past it */
+	int bad;					/** set on an ordinal out of the dictionary */
+} d_merge_input_t;
+
+/** Open an input of dualclue_index_merge_files() and check it against the first one */
+static int d_merge_input_open(d_merge_input_t* in, const char* filename, d_merge_input_t* first, uttdict_t* utts)
+{
+	int i;
+	uttdict_t* d;
+	
+	if ( (in->fp = fopen(filename, "rb")) == NULL) {
+		perror("dualclue_index_merge_files: BAD filename");
+		return -1;
+	}
+	if (fread(&(in->header), sizeof(d_bin_header_t), 1, in->fp) != 1
+		|| strncmp(in->header.magic, DUALCLUE_BIN_MAGIC, sizeof(in->header.magic)) != 0
+		|| in->header.version != DUALCLUE_BIN_VERSION
+		|| (first && in->header.n_word != first->header.n_word)) {
+		fprintf(stderr, "dualclue_index_merge_files: %s: bad header, version or word list\n", filename);
+		return -1;
+	}
+	in->words = (d_bin_word_t*) malloc((in->header.n_word + 1) * sizeof(d_bin_word_t));
+	if (fseeko(in->fp, (off_t) in->header.word_off, SEEK_SET) != 0
+		|| fread(in->words, sizeof(d_bin_word_t), in->header.n_word, in->fp) != in->header.n_word) {
+		fprintf(stderr, "dualclue_index_merge_files: %s: truncated word table\n", filename);
+		return -1;
+	}
+	for (i = 0; first && i < (int) in->header.n_word; i++) {
+		if (strncmp(in->words[i].word, first->words[i].word, WORD_MAX_LENGTH) != 0) {
+			fprintf(stderr, "dualclue_index_merge_files: %s: different word list\n", filename);
+			return -1;
+		}
+	}
+	if (fseeko(in->fp, (off_t) in->header.utts_off, SEEK_SET) != 0
+		|| (d = uttdict_read_fp(in->fp, in->header.utts_size)) == NULL) {
+		fprintf(stderr, "dualclue_index_merge_files: %s: bad utterance dictionary\n", filename);
+		return -1;
+	}
+	in->utt_map = uttdict_map(utts, d);
+	in->n_utt = uttdict_size(d);
+	uttdict_free(d);
+	return 0;
+}
+
+/** Point the directory reader of **in** at the positions of word **wid** */
+static void d_merge_input_seek_word(d_merge_input_t* in, int wid)
+{
+	bufio_seek(in->dir, (off_t) (in->header.pos_off + (uint64_t) in->words[wid].first_pos * sizeof(d_bin_pos_t)),
+		in->words[wid].n_pos);
+	in->pos = (const d_bin_pos_t*) bufio_read(in->dir);
+}
+
+/** Next hit of **in** at the current position, with its ordinal translated */
+static const d_bin_hit_t* d_merge_input_next_hit(d_merge_input_t* in, d_bin_hit_t* rec)
+{
+	const d_bin_hit_t* hit = (const d_bin_hit_t*) bufio_read(in->hits);
+	if (!hit)
+		return NULL;
+	if (hit->utt < 0 || hit->utt >= in->n_utt) {
+		in->bad = 1;
+		return NULL;
+	}
+	rec->utt = in->utt_map[hit->utt];
+	rec->post = hit->post;
+	return rec;
+}
+
+int dualclue_index_merge_files(const char* const* inputs, int n_input, const char* output, size_t buf_size)
+{
+	int i, n, best, rv = -1;
+	int32 pos = 0;
+	size_t n_buf;
+	FILE* fp = NULL;
+	bufio_t *out_dir = NULL, *out_hits = NULL;
+	d_merge_input_t* in;
+	d_bin_hit_t* cur;	/** current translated hit of every input */
+	d_bin_header_t header;
+	d_bin_word_t* words = NULL;
+	d_bin_pos_t dir;
+	uttdict_t* utts = uttdict_init();
+	
+	if (n_input <= 0) {
+		perror("dualclue_index_merge_files: no input");
+		return -1;
+	}
+	in = (d_merge_input_t*) calloc(n_input, sizeof(d_merge_input_t));
+	cur = (d_bin_hit_t*) calloc(n_input, sizeof(d_bin_hit_t));
+	for (i = 0; i < n_input; i++) {
+		if (d_merge_input_open(&(in[i]), inputs[i], i ? &(in[0]) : NULL, utts) < 0)
+			goto exit;
+	}
+	if ( (fp = fopen(output, "wb")) == NULL) {
+		perror("dualclue_index_merge_files: BAD filename");
+		goto exit;
+	}
+	
+	/** two readers per input and two writers, of at most a directory entry per record */
+	n_buf = buf_size / ((2 * n_input + 2) * sizeof(d_bin_pos_t));
+	if (n_buf < 16)
+		n_buf = 16;
+	for (i = 0; i < n_input; i++) {
+		in[i].dir = bufio_init(in[i].fp, sizeof(d_bin_pos_t), n_buf);
+		in[i].hits = bufio_init(in[i].fp, sizeof(d_bin_hit_t), n_buf);
+	}
+	out_dir = bufio_init(fp, sizeof(d_bin_pos_t), n_buf);
+	out_hits = bufio_init(fp, sizeof(d_bin_hit_t), n_buf);
+	
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, DUALCLUE_BIN_MAGIC, sizeof(header.magic));
+	header.version = DUALCLUE_BIN_VERSION;
+	header.n_word = in[0].header.n_word;
+	words = (d_bin_word_t*) calloc(header.n_word + 1, sizeof(d_bin_word_t));
+	
+	/** 1st pass: the union of the position directories sizes the output directory */
+	for (i = 0; i < (int) header.n_word; i++) {
+		memcpy(words[i].word, in[0].words[i].word, WORD_MAX_LENGTH + 1);
+		words[i].first_pos = header.n_pos;
+		for (n = 0; n < n_input; n++) {
+			d_merge_input_seek_word(&(in[n]), i);
+		}
+		for (;;) {
+			for (best = -1, n = 0; n < n_input; n++) {
+				if (in[n].pos && (best < 0 || in[n].pos->pos < pos)) {
+					best = n;
+					pos = in[n].pos->pos;
+				}
+			}
+			if (best < 0)
+				break;
+			for (n = 0; n < n_input; n++) {
+				if (in[n].pos && in[n].pos->pos == pos) 
+					in[n].pos = (const d_bin_pos_t*) bufio_read(in[n].dir);
+			}
+			header.n_pos++;
+		}
+		words[i].n_pos = header.n_pos - words[i].first_pos;
+	}
+	for (n = 0; n < n_input; n++) {
+		header.n_hit += in[n].header.n_hit;
+	}
+	header.word_off = sizeof(d_bin_header_t);
+	header.pos_off = header.word_off + (uint64_t) header.n_word * sizeof(d_bin_word_t);
+	header.hits_off = header.pos_off + (uint64_t) header.n_pos * sizeof(d_bin_pos_t);
+	header.utts_off = header.hits_off + (uint64_t) header.n_hit * sizeof(d_bin_hit_t);
+	
+	/** 2nd pass: the hits of a position are merged by utterance, input order breaking ties */
+	bufio_seek(out_dir, (off_t) header.pos_off, 0);
+	bufio_seek(out_hits, (off_t) header.hits_off, 0);
+	dir.first_hit = 0;
+	for (i = 0; i < (int) header.n_word; i++) {
+		for (n = 0; n < n_input; n++) {
+			d_merge_input_seek_word(&(in[n]), i);
+		}
+		for (;;) {
+			for (best = -1, n = 0; n < n_input; n++) {
+				if (in[n].pos && (best < 0 || in[n].pos->pos < pos)) {
+					best = n;
+					pos = in[n].pos->pos;
+				}
+			}
+			if (best < 0)
+				break;
+			for (n = 0; n < n_input; n++) {
+				in[n].hit = NULL;
+				if (in[n].pos && in[n].pos->pos == pos) {
+					bufio_seek(in[n].hits, (off_t) (in[n].header.hits_off + (uint64_t) in[n].pos->first_hit * sizeof(d_bin_hit_t)),
+						in[n].pos->n_hit);
+					in[n].hit = d_merge_input_next_hit(&(in[n]), &(cur[n]));
+					in[n].pos = (const d_bin_pos_t*) bufio_read(in[n].dir);
+				}
+			}
+			dir.pos = pos;
+			dir.n_hit = 0;
+			for (;;) {
+				for (best = -1, n = 0; n < n_input; n++) {
+					if (in[n].hit && (best < 0 || in[n].hit->utt < in[best].hit->utt))
+						best = n;
+				}
+				if (best < 0)
+					break;
+				bufio_write(out_hits, in[best].hit);
+				dir.n_hit++;
+				in[best].hit = d_merge_input_next_hit(&(in[best]), &(cur[best]));
+			}
+			bufio_write(out_dir, &dir);
+			dir.first_hit += dir.n_hit;
+		}
+	}
+	for (n = 0; n < n_input; n++) {
+		if (bufio_error(in[n].dir) || bufio_error(in[n].hits) || in[n].bad) {
+			fprintf(stderr, "dualclue_index_merge_files: %s: truncated or corrupted\n", inputs[n]);
+			goto exit;
+		}
+	}
+	if (bufio_flush(out_dir) < 0 || bufio_flush(out_hits) < 0 || dir.first_hit != header.n_hit) {
+		perror("dualclue_index_merge_files: write error");
+		goto exit;
+	}
+	
+	fseeko(fp, (off_t) header.utts_off, SEEK_SET);
+	header.utts_size = uttdict_write(utts, fp);
+	fseek(fp, 0, SEEK_SET);
+	fwrite(&header, sizeof(header), 1, fp);
+	fwrite(words, sizeof(d_bin_word_t), header.n_word, fp);
+	if (ferror(fp)) {
+		perror("dualclue_index_merge_files: write error");
+		goto exit;
+	}
+	rv = 0;
+	
+exit:
+	for (i = 0; i < n_input; i++) {
+		bufio_free(in[i].dir);
+		bufio_free(in[i].hits);
+		if (in[i].fp)
+			fclose(in[i].fp);
+		free(in[i].words);
+		free(in[i].utt_map);
+	}
+	bufio_free(out_dir);
+	bufio_free(out_hits);
+	if (fp && fclose(fp) != 0)
+		rv = -1;
+	free(in);
+	free(cur);
+	free(words);
+	uttdict_free(utts);
+	return rv;
+}
+
 /**
  * s_partial_path_t
  */
 typedef struct s_partial_path_s {
-    s_hit_t* first_term;
-    s_hit_t* last_term;
+    s_hit_t term;       /** last term of the path */
+    struct s_partial_path_s *parent;    /** the path without its last term, NULL for the first term */
+    struct s_partial_path_s *first;     /** node of the first term */
     int n_term;
 	int pos;
 	int32 post;
-    struct s_partial_path_s *next;
+    struct s_partial_path_s *next;      /** next path in the queue */
 } s_partial_path_t;
 
 /**
@@ -903,112 +1953,40 @@ typedef struct s_path_queue_s {
     int n_path;
 } s_path_queue_t; 
 
-/** Initialize an empty path */ 
-s_partial_path_t* s_partial_path_init() {
-    s_partial_path_t* p;
-    p = (s_partial_path_t*) calloc(1, sizeof(s_partial_path_t) );
-    return p;
-}
-
-/** Finalize a path */ 
-void s_partial_path_free(s_partial_path_t* p) 
-{
-    if (p) {
-        s_hit_t* h;
-        while (p->first_term) {
-            h = p->first_term;
-            p->first_term = p->first_term->next;
-            /** Don't forget to free the **uttid** member in hit_t */
-            free(h->uttid); 
-            free(h);
-            p->n_term--;
-        }
-        free(p);
-    }
-}
-
-/** Extend the path with a new term */
-int s_partial_path_extend(s_partial_path_t* p, s_hit_t* h) 
+/** Extend **parent** with a new term, sharing its prefix; a NULL **parent** starts a new path */
+s_partial_path_t* s_partial_path_extend(s_partial_path_t* parent, s_hit_t* h, arena_t* arena) 
 {
-    if (!p) 
-        return -1;
+    s_partial_path_t* p;
     if (!h)
-        return -1;
-
-    s_hit_t* hit;
-    hit = (s_hit_t*) malloc(sizeof(s_hit_t));
-    
-    hit->uttid = (char*) malloc(MAX_LINE_LENGTH * sizeof(char));
-    memset(hit->uttid, 0, MAX_LINE_LENGTH * sizeof(char));
-    strncpy(hit->uttid, h->uttid, strlen(h->uttid));
-    hit->post = h->post;
-	hit->next = NULL;
-    if (p->n_term == 0) {
-        p->first_term = hit;
-    } else {
-        p->last_term->next = hit;
-    }
-    p->last_term = hit;
-    p->n_term++;
-    return 0; 
-}
-
-/** Genarete a new path from an existing one */
-s_partial_path_t* s_partial_path_copy(s_partial_path_t* p) {
-       if (!p) {
-           return NULL;
-       }
-       s_hit_t* h;
-       s_partial_path_t* out = s_partial_path_init();
-       for (h = p->first_term; h; h = h->next) {
-            if (s_partial_path_extend(out, h) != 0) {
-                perror("Add hits to path failure");
-                s_partial_path_free(out);
-                return NULL;
-            }
-       }
-	   out->post = p->post;
-       out->next = NULL;
-       return out;
+        return NULL;
+    p = (s_partial_path_t*) arena_calloc(arena, 1, sizeof(s_partial_path_t) );
+    p->term = *h;
+    p->term.next = NULL;
+    p->parent = parent;
+    p->first = parent ? parent->first : p;
+    p->n_term = parent ? parent->n_term + 1 : 1;
+    return p;
 }
 
-
-/** Get posterior log-likelihood of the partial path: P(path|O) */
+/** Get posterior log-likelihood of the partial path: P(path|O), from the parent's score */
 int32 s_partial_path_get_posterior(s_partial_path_t* p)
 {
-    s_hit_t* hit;
-    int32 result = 0;	
-	for (hit = p->first_term; hit; hit = hit->next) {
-		result += hit->post;
-	}
-    return result;
+    return (p->parent ? p->parent->post : 0) + p->term.post;
 }
 
 /* =====================================================================
  * path_queue_t's function definitions 
  * ===================================================================== */ 
  
-s_path_queue_t* s_path_queue_init() 
+/** A queue and its paths live in **arena**, they are dropped with it */
+s_path_queue_t* s_path_queue_init(arena_t* arena) 
 {
-    s_path_queue_t* q = (s_path_queue_t*) malloc( sizeof(s_path_queue_t) );
+    s_path_queue_t* q = (s_path_queue_t*) arena_alloc(arena, sizeof(s_path_queue_t) );
     q->head = q->tail = NULL;
     q->n_path = 0;
     return q;
 }
 
-void s_path_queue_free(s_path_queue_t* q)
-{
-    if (!q) return;
-    s_partial_path_t* p;
-    while (q->head) {
-        p = q->head;
-        q->head = q->head->next;
-        s_partial_path_free(p);
-        q->n_path--;
-    }
-    free(q);    
-}
-
 void s_path_queue_add(s_path_queue_t* q, s_partial_path_t* p) {
     if (!q) {
         perror("s_path_queue_add: No queue object");
@@ -1037,72 +2015,71 @@ void s_path_queue_add(s_path_queue_t* q, s_partial_path_t* p) {
     q->n_path++;
 }
 
-void s_path_queue_print(s_path_queue_t* q)
+void s_path_queue_print(s_path_queue_t* q, uttdict_t* utts)
 {
 	s_partial_path_t *p;
 	printf("#PATH:%d\n", q->n_path);
 	for (p = q->head; p; p = p->next) {
-			printf("%s %d\n", p->first_term->uttid, p->post);
+			printf("%s %d\n", uttdict_str(utts, p->first->term.utt), p->post);
 		}
 }
 		
-void s_path_queue_sort(s_path_queue_t** q)
-{
-	s_path_queue_t* q_sorted = s_path_queue_init();
-	s_path_queue_add(q_sorted, s_partial_path_copy((*q)->head)); 
-	//s_path_queue_print(q_sorted);
-	s_partial_path_t *i, *j, *j_prev;
-	for (i = (*q)->head->next; i; i = i->next) {
-		for (j = q_sorted->head; j; j = j->next) {
-			if ( i->post > j->post) {
-				s_partial_path_t *new_i = s_partial_path_copy(i);
-				if ( j == q_sorted->head) {					
-					q_sorted->head = new_i;					
-				} else {
-					j_prev->next = new_i;
-				}
-				new_i->next = j;
-				q_sorted->n_path++;
-				break;
-			} else {
-				j_prev = j;
-			}
-		}
-		// add to the tail
-		if ( j_prev == q_sorted->tail) {
-			s_path_queue_add(q_sorted, s_partial_path_copy(i)); 
-		}
-		//s_path_queue_print(q_sorted);
-	}
-	
-	s_path_queue_free(*q);
-	*q = q_sorted; 
+/** Select the **n_best** best paths into **top** the way path_queue_top() does for lattices */
+int s_path_queue_top(s_path_queue_t* q, int n_best, s_partial_path_t*** top, arena_t* arena)
+{
+    int n = 0, k, seq = 0;
+    s_partial_path_t* p;
+    result_rank_t* heap;
+    
+    k = (n_best <= 0 || n_best > q->n_path) ? q->n_path : n_best;
+    *top = (s_partial_path_t**) arena_alloc(arena, (k ? k : 1) * sizeof(s_partial_path_t*));
+    if (k == 0)
+        return 0;
+    heap = (result_rank_t*) arena_alloc(arena, k * sizeof(result_rank_t));
+    for (p = q->head; p; p = p->next) {
+        n = result_rank_add(heap, n, k, p, p->post, seq++);
+    }
+    result_rank_sort(heap, n);
+    for (n = 0; n < k; n++) {
+        (*top)[n] = (s_partial_path_t*) heap[n].item;
+    }
+    return k;
 }
 
 
-void dualclue_index_search(dualclue_index_t* index, char** terms, int n_term)
+int dualclue_index_search_cb(dualclue_index_t* index, char** terms, int n_term, int n_best, result_cb_t cb, void* data)
 {
 	int i;
-	s_path_queue_t** queues = (s_path_queue_t**) calloc(n_term, sizeof(s_path_queue_t*));
+	int n_result = 0;
+	result_t r;
+	if (!index || !terms || n_term <= 0) {
+		perror("dualclue_index_search: no index or query terms");
+		return -1;
+	}
+	/** everything the query allocates is dropped at once when it returns */
+	arena_t* arena = arena_thread_acquire();
+	s_path_queue_t** queues = (s_path_queue_t**) arena_alloc(arena, n_term * sizeof(s_path_queue_t*));
 	for (i = 0; i < n_term; i++) {
-		queues[i] = s_path_queue_init();
+		queues[i] = s_path_queue_init(arena);
 	}
 	// Process the 1st query term
 	int wid = dualclue_index_get_wid(index, terms[0]);
 	if (wid == -1)
 		goto exit;
-	s_hits_word_t* hits_word = &(index->s_hits[wid]);
-	s_hits_pos_t* hits_pos;
+	/** late hits are put in order on first use, see dualclue_index_freeze() */
+	dualclue_index_sort_word(index, wid);
+	s_hit_iter_t it;
 	s_hit_t* hit; 
-	for (hits_pos = hits_word->first; hits_pos; hits_pos = hits_pos->next) {
-		hit = hits_pos->first;
-		while (hit) {
-			s_partial_path_t* p = s_partial_path_init();
-			s_partial_path_extend(p, hit);
-			p->pos = hits_pos->pos;
+	int* positions;
+	int j, n_pos;
+	positions = (int*) arena_alloc(arena, (dualclue_index_max_positions(index, wid) + 1) * sizeof(int));
+	n_pos = dualclue_index_fill_positions(index, wid, positions);
+	for (j = 0; j < n_pos; j++) {
+		for (hit = s_hit_iter_init(&it, index, wid, positions[j]); hit; hit = s_hit_iter_next(&it)) {
+			s_partial_path_t* p = s_partial_path_extend(NULL, hit, arena);
+			p->pos = positions[j];
 			p->post = s_partial_path_get_posterior(p);
 			s_path_queue_add(queues[0], p);
-			hit = hit->next;
 		}
 	}
 	for (i = 1; i < n_term; i++ ) {
@@ -1110,36 +2087,54 @@ void dualclue_index_search(dualclue_index_t* index, char** terms, int n_term)
 			goto exit;
 		}
 		wid = dualclue_index_get_wid(index, terms[i]);
-		hits_word = &(index->s_hits[wid]);
+		if (wid == -1)
+			goto exit;
+		dualclue_index_sort_word(index, wid);
 		s_partial_path_t* p;
 		for (p = queues[i-1]->head; p; p = p->next) {
-			hits_pos = s_hits_word_get_pos(hits_word, p->pos + 1); // adjust position range
-			if (!hits_pos) {
-				continue;
-			}
-			hit = hits_pos->first;
-			while (hit) {
-				if ( strncmp(hit->uttid, p->first_term->uttid, strlen(hit->uttid)) == 0) {
-					s_partial_path_t* q = s_partial_path_copy(p);
-					s_partial_path_extend(q, hit);
-					q->pos = hits_pos->pos;
+			// adjust position range
+			for (hit = s_hit_iter_init(&it, index, wid, p->pos + 1); hit; hit = s_hit_iter_next(&it)) {
+				if (hit->utt == p->first->term.utt) {
+					s_partial_path_t* q = s_partial_path_extend(p, hit, arena);
+					q->pos = p->pos + 1;
 					q->post = s_partial_path_get_posterior(q);
 					s_path_queue_add(queues[i], q);
 				}
-				hit = hit->next;
 			}
 		}	
 	}
 	
 	if ( i == n_term) {
-		s_partial_path_t* p;		
-		s_path_queue_sort(&(queues[n_term-1]));
-		s_path_queue_print(queues[n_term-1]);
+		s_partial_path_t** top;
+		int n_top = s_path_queue_top(queues[n_term-1], n_best, &top, arena);
+		for (j = 0; j < n_top; j++) {
+			r.utt = top[j]->first->term.utt;
+			/** the file is not scanned on load, a corrupt ordinal is caught here */
+			if ( (r.uttid = uttdict_str(index->utts, r.utt)) == NULL)
+				continue;
+			r.start = top[j]->first->pos;
+			r.end = top[j]->pos;
+			r.frate = 0;
+			r.score = top[j]->post;
+			r.next = NULL;
+			n_result++;
+			if (cb(&r, data))
+				break;
+		}
 	}
 	
 exit:
-	for (i = 0; i < n_term; i++) {
-		s_path_queue_free(queues[i]);
+	arena_thread_release(arena);
+	return n_result;
+}
+
+int dualclue_index_search(dualclue_index_t* index, char** terms, int n_term, int n_best, result_list_t** rl)
+{
+	int n_result;
+	*rl = result_list_init();
+	if ( (n_result = dualclue_index_search_cb(index, terms, n_term, n_best, result_list_add, *rl)) < 0) {
+		result_list_free(*rl);
+		*rl = NULL;
 	}
-	free(queues);
+	return n_result;
 }
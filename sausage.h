@@ -9,6 +9,9 @@
 #define __SAUSAGE_H__
 
 #include "pocketsphinx.h"
+#include "uttdict.h"
+#include "vocab.h"
+#include "result.h"
 
 /**
  * node_t
@@ -31,11 +34,47 @@ typedef struct edge_set_s edge_set_t;
  */
 typedef struct sausage_s sausage_t;
 
+/***
+ * sim_table_t
+ * similarity of every two words of a vocabulary, computed once
+ */
+typedef struct sim_table_s sim_table_t;
+
+/**
+ * function: sim_table_init()
+ * Precompute the edit costs between all the words of **vocab**, to be shared by the threads
+ * building sausages. Returns NULL on error.
+ */
+sim_table_t* sim_table_init(vocab_t* vocab);
+void sim_table_free(sim_table_t* sim);
+
 /**
  * function: convert_lattice_to_sausage()
- * convert incoming lattice to a sausage.
+ * convert incoming lattice to a sausage. Words are compared through **sim** when both are in
+ * its vocabulary, others (and all of them if **sim** is NULL) by computing their edit distance.
+ */
+sausage_t* convert_lattice_to_sausage(ps_lattice_t* dag, sim_table_t* sim);
+/**
+ * function: convert_lattice_to_sausage_pivot()
+ * convert incoming lattice to a sausage whose slots are the links of its best path, every other
+ * link going to the slot it overlaps most in time. One pass over the lattice, no word comparison.
+ */
+sausage_t* convert_lattice_to_sausage_pivot(ps_lattice_t* dag);
+
+/***
+ * sausage_builder_t
+ * the algorithm turning lattices into sausages, a trade of accuracy for throughput
+ */
+typedef enum sausage_builder_e {
+    SAUSAGE_BUILDER_IMPROVED = 0,   /** convert_lattice_to_sausage(), the default */
+    SAUSAGE_BUILDER_PIVOT           /** convert_lattice_to_sausage_pivot() */
+} sausage_builder_t;
+
+/**
+ * function: sausage_build()
+ * convert incoming lattice to a sausage with **builder**; **sim** is only used by the improved one
  */
-sausage_t* convert_lattice_to_sausage(ps_lattice_t* dag);
+sausage_t* sausage_build(ps_lattice_t* dag, sausage_builder_t builder, sim_table_t* sim);
 /**
  * function: sausage_wirte()
  * sausage_wirte
@@ -44,17 +83,41 @@ void sausage_write(sausage_t* s, ps_lattice_t* dag, const char* filename);
 void sausage_free(sausage_t* s);
 void sausage_last_node_set(sausage_t* s,  ps_lattice_t* dag);
 
-typedef struct lite_node_s lite_node_t;
-typedef struct lite_edge_s lite_edge_t;
-typedef struct lite_edge_set_s lite_edge_set_t;
+/***
+ * lite_sausage_t
+ * a sausage reduced to the words of each slot and their posteriors
+ */
 typedef struct lite_sausage_s lite_sausage_t;
 /**
  * function: sausage_simplify()
- * simplify sausage to a lite one
+ * simplify sausage to a lite one: the edges of a slot with the same word are merged and their
+ * posteriors log-added. Words are kept as wids of **vocab**, those outside it are left out.
  */
-lite_sausage_t* sausage_simplify(sausage_t* s, ps_lattice_t* dag);
+lite_sausage_t* sausage_simplify(sausage_t* s, ps_lattice_t* dag, vocab_t* vocab);
 void lite_sausage_write(lite_sausage_t* lite_s, const char* filename);
 void lite_sausage_free(lite_sausage_t* lite_s);
+/**
+ * function: lite_sausage_init()
+ * Build a lite sausage of **n_slot** slots from its arrays, copied: the words of slot i are
+ * wid[off[i]] .. wid[off[i+1]-1], wids of **vocab**, with their posteriors in **post**.
+ */
+lite_sausage_t* lite_sausage_init(vocab_t* vocab, int n_slot, const int32* off, const int32* wid, const int32* post);
+/**
+ * function: lite_sausage_n_slot()
+ * number of slots, i.e. of positions
+ */
+int lite_sausage_n_slot(lite_sausage_t* lite_s);
+/**
+ * function: lite_sausage_slot()
+ * point **wid** and **post** to the words of **slot** and their posteriors, valid as long as the
+ * lite sausage. Returns the number of words, -1 if there is no such slot.
+ */
+int lite_sausage_slot(lite_sausage_t* lite_s, int slot, const int32** wid, const int32** post);
+/**
+ * function: lite_sausage_get_vocab()
+ * the vocabulary the wids refer to
+ */
+vocab_t* lite_sausage_get_vocab(lite_sausage_t* lite_s);
 
 typedef struct s_hit_s s_hit_t;
 typedef struct s_hits_pos_s s_hits_pos_t;
@@ -64,11 +127,99 @@ typedef struct dualclue_index_s dualclue_index_t;
 
 
 dualclue_index_t* dualclue_index_init(const char* filename);
+/**
+ * function: dualclue_index_init_vocab()
+ * create an empty dual-clue index over an existing vocabulary, e.g. the one of a lattice index
+ */
+dualclue_index_t* dualclue_index_init_vocab(vocab_t* vocab);
+/**
+ * function: dualclue_index_get_vocab()
+ * the vocabulary of the index
+ */
+vocab_t* dualclue_index_get_vocab(dualclue_index_t* index);
 dualclue_index_t* dualclue_index_read(const char* filename);
 void dualclue_index_write(dualclue_index_t* index, const char* filename);
+/**
+ * function: dualclue_index_read_bin()
+ * map a binary dual-clue index; vocabulary, position directories and hits are used in place.
+ * Loading checks the word table and the position directories, not the hits: utterance
+ * ordinals are not checked on load, search skips spans outside the dictionary.
+ */
+dualclue_index_t* dualclue_index_read_bin(const char* filename);
+/**
+ * function: dualclue_index_write_bin()
+ * save a dual-clue index in the versioned binary format
+ */
+int dualclue_index_write_bin(dualclue_index_t* index, const char* filename);
 void dualclue_index_addhit(dualclue_index_t* index, const char* uttid, lite_sausage_t* lite_s);
+/**
+ * function: dualclue_index_freeze()
+ * Put the hits of every position in utterance order, those published late were appended.
+ * Searches then only read the index, so several of them may run at once as long as nothing
+ * is added.
+ */
+void dualclue_index_freeze(dualclue_index_t* index);
 void dualclue_index_free(dualclue_index_t* index);
+/**
+ * function: dualclue_index_get_uttdict()
+ * the utterance dictionary the hits refer to
+ */
+uttdict_t* dualclue_index_get_uttdict(dualclue_index_t* index);
+/**
+ * function: dualclue_index_set_uttdict()
+ * share **utts** with another index (e.g. the lattice index); only allowed while the index holds no hits
+ */
+int dualclue_index_set_uttdict(dualclue_index_t* index, uttdict_t* utts);
+/**
+ * function: dualclue_index_set_builder()
+ * choose how the sausages of this collection are built by ingest, see sausage_build(); staging
+ * indexes take the choice of their target
+ */
+void dualclue_index_set_builder(dualclue_index_t* index, sausage_builder_t builder);
+sausage_builder_t dualclue_index_get_builder(dualclue_index_t* index);
 /*
 dualclue_index_cache_t* dualclue_index_get_cache(dualclue_index_t* index);*/
-void dualclue_index_search(dualclue_index_t* index, char** terms, int n_term);
+/**
+ * function: dualclue_index_merge()
+ * Append the hits of **src** to **dst**; both must use the same word list. Utterance
+ * ordinals are translated if the indexes do not share a dictionary. Returns 0, -1 on error.
+ * Several merges into the same **dst** may run at once, they lock one stripe of words at a time.
+ */
+int dualclue_index_merge(dualclue_index_t* dst, dualclue_index_t* src);
+/**
+ * function: dualclue_index_merge_files()
+ * Merge the binary indexes **inputs**, written by dualclue_index_write_bin() over the same word
+ * list, into the binary index **output**, streaming the position directories and hits through
+ * about **buf_size** bytes of buffers. Returns 0, -1 on error.
+ */
+int dualclue_index_merge_files(const char* const* inputs, int n_input, const char* output, size_t buf_size);
+
+/**
+ * function: dualclue_index_stage_init()
+ * Create a private staging index for one thread, sharing the word list of **index**
+ */
+dualclue_index_t* dualclue_index_stage_init(dualclue_index_t* index);
+/**
+ * function: dualclue_index_publish()
+ * Move the hits of **stage** to **index** and empty the stage. Threads may publish at once;
+ * the hits of a position are kept in utterance order, so the content does not depend on the
+ * order of publication. Utterance ordinals, and with them the order of the hits of a position,
+ * do, unless the ids were interned in **index** beforehand. Not to be mixed with searches or
+ * writes of **index**.
+ */
+int dualclue_index_publish(dualclue_index_t* index, dualclue_index_t* stage);
+/**
+ * function: dualclue_index_search_cb()
+ * Hand the **n_best** best slot spans matching all query terms at consecutive positions to
+ * **cb**, best first, every span if **n_best** <= 0. The spans are ranked once the whole query
+ * is matched, so **cb** returning nonzero only stops delivering results.
+ * Returns the number of results delivered, -1 on error.
+ */
+int dualclue_index_search_cb(dualclue_index_t* index, char** terms, int n_term, int n_best, result_cb_t cb, void* data);
+/**
+ * function: dualclue_index_search()
+ * Collect the **n_best** best slot spans in a new list **rl**, to be freed with result_list_free().
+ * Returns the number of results, -1 on error.
+ */
+int dualclue_index_search(dualclue_index_t* index, char** terms, int n_term, int n_best, result_list_t** rl);
 #endif
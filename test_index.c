@@ -62,13 +62,24 @@ int main(int argc, char** argv)
     //printf("%d: %s\n", inverted_index_get_wid(index, "bia"), "bia");
     inverted_index_addhits(index, "test", dag, 1.0/ascale);
     inverted_index_write(index, "./index");
+    inverted_index_write_bin(index, "./index.bin");
     inverted_index_free(index);
-    index = inverted_index_read("./index");
+    index = inverted_index_read_bin("./index.bin");
+    if (index == NULL) {
+       exit(1);
+    }
     inverted_index_write(index, "./index2");
     
     char* query[] = {"jin", "tian", "jie", "mu"};
     result_list_t* rl;
-    inverted_index_search(index, ps_get_lmset(ps), 1.0/ascale, query, 4, &rl);
+    const result_t* r;
+    if (inverted_index_search(index, ps_get_lmset(ps), 1.0/ascale, query, 4, 10, &rl) >= 0) {
+        printf("#result: %d\n", result_list_size(rl));
+        for (r = result_list_first(rl); r; r = r->next) {
+            printf("%s[%.2f-%.2f] %d\n", r->uttid, (double) r->start / r->frate, (double) r->end / r->frate, r->score);
+        }
+        result_list_free(rl);
+    }
 
 	inverted_index_free(index);
 	return 0;
@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ingest.h"
+
+
+int main(int argc, char** argv)
+{
+    int n_worker, n_done;
+    cmd_ln_t *config;
+    vocab_t* vocab;
+    inverted_index_t* index;
+    dualclue_index_t* dc_index;
+    artifact_writer_t* archive = NULL;
+    inverted_index_stats_t stats;
+    
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s MANIFEST [N_WORKER [ARCHIVE]]\n", argv[0]);
+        return 1;
+    }
+    n_worker = (argc > 2) ? atoi(argv[2]) : 4;
+
+    config = cmd_ln_init(NULL, ps_args(), TRUE,
+			     "-hmm", "./hmm/zh_broadcastnews_ptm256_8000",
+			     "-lm", "./lm/syllables.lm.DMP",
+			     "-dict", "./lm/syllables_sorted.dic",
+			     NULL);
+	if (config == NULL)
+		return 1;
+    
+    /** both indexes share the word list and the utterance ids */
+    if ( (vocab = vocab_read("./syllable.lst")) == NULL) 
+        return 1;
+    index = inverted_index_init_vocab(vocab);
+    inverted_index_set_pruning(index, 1e-4, 200);
+    dc_index = dualclue_index_init_vocab(vocab);
+    dualclue_index_set_uttdict(dc_index, inverted_index_get_uttdict(index));
+    /** keep what was decoded, to rebuild the indexes with other settings by reindex */
+    if (argc > 3 
+        && (archive = artifact_writer_init(argv[3], vocab, cmd_ln_float32_r(config, "-logbase"))) == NULL)
+        return 1;
+    vocab_free(vocab);
+    
+    n_done = ingest_manifest(config, argv[1], n_worker, index, dc_index, archive);
+    if (artifact_writer_free(archive) < 0 || n_done < 0)
+        return 1;
+    printf("Indexed %d utterances with %d workers\n", n_done, n_worker);
+    inverted_index_get_stats(index, &stats);
+    printf("Links: %ld, pruned by posterior: %ld, by cap: %ld, indexed: %ld\n",
+            stats.n_link, stats.n_pruned_posterior, stats.n_pruned_cap, stats.n_hit);
+    
+    inverted_index_write_bin(index, "./index.bin");
+    dualclue_index_write_bin(dc_index, "./dualclue_index.bin");
+    
+    dualclue_index_free(dc_index);
+    inverted_index_free(index);
+    cmd_ln_free_r(config);
+	return 0;
+}
@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "live.h"
+
+typedef struct searcher_s {
+    live_index_t* live;
+    float32 ascale;
+    volatile int done;
+} searcher_t;
+
+static double now_ms(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+/** Query the live index over and over while the main thread publishes segments */
+static void* search_loop(void* arg)
+{
+    searcher_t* s = (searcher_t*) arg;
+    char* query[] = {"jin", "tian", "jie", "mu"};
+    result_list_t* rl;
+    live_snapshot_t* snap;
+    double t0, t1, worst = 0;
+    int n_search = 0, n_result;
+
+    while (!s->done) {
+        t0 = now_ms();
+        snap = live_index_pin(s->live);
+        rl = result_list_init();
+        n_result = live_snapshot_search_cb(snap, s->ascale, query, 4, 10, result_list_add, rl);
+        t1 = now_ms();
+        if (t1 - t0 > worst)
+            worst = t1 - t0;
+        if (n_search++ % 100 == 0)
+            printf("version %d, %d segments: %d results in %.3f ms\n",
+                    live_snapshot_version(snap), live_snapshot_n_segment(snap), n_result, t1 - t0);
+        result_list_free(rl);
+        live_snapshot_release(snap);
+    }
+    printf("%d searches, slowest %.3f ms\n", n_search, worst);
+    return NULL;
+}
+
+int main(int argc, char** argv)
+{
+    int i;
+    FILE* fh;
+    cmd_ln_t *config;
+    ps_decoder_t *ps;
+    ps_lattice_t* dag;
+    vocab_t* vocab;
+    inverted_index_t* seg;
+    searcher_t searcher;
+    pthread_t thread;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s AUDIO...\n", argv[0]);
+        return 1;
+    }
+    config = cmd_ln_init(NULL, ps_args(), TRUE,
+			     "-hmm", "./hmm/zh_broadcastnews_ptm256_8000",
+			     "-lm", "./lm/syllables.lm.DMP",
+			     "-dict", "./lm/syllables_sorted.dic",
+			     NULL);
+	if (config == NULL)
+		return 1;
+	ps = ps_init(config);
+	if (ps == NULL)
+		return 1;
+    if ( (vocab = vocab_read("./syllable.lst")) == NULL)
+        return 1;
+
+    /** segments persist in ./segments, a second run adds to them */
+    if ( (searcher.live = live_index_open("./segments", vocab, ps_get_lmset(ps))) == NULL)
+        return 1;
+    live_index_start_compactor(searcher.live);
+    searcher.ascale = 1.0/cmd_ln_float32_r(config, "-ascale");
+    searcher.done = 0;
+    pthread_create(&thread, NULL, search_loop, &searcher);
+
+    /** one segment per recording */
+    for (i = 1; i < argc; i++) {
+        if ( (fh = fopen(argv[i], "rb")) == NULL) {
+            perror("Failed to open audio file.");
+            continue;
+        }
+        if (ps_decode_raw(ps, fh, argv[i], -1) < 0 || (dag = ps_get_lattice(ps)) == NULL) {
+            fclose(fh);
+            continue;
+        }
+        fclose(fh);
+        seg = inverted_index_init_vocab(vocab);
+        inverted_index_addhits(seg, argv[i], dag, searcher.ascale);
+        live_index_publish(searcher.live, seg, NULL);
+    }
+
+    searcher.done = 1;
+    pthread_join(thread, NULL);
+    live_index_free(searcher.live);
+    vocab_free(vocab);
+    ps_free(ps);
+    cmd_ln_free_r(config);
+	return 0;
+}
@@ -1,9 +1,19 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include "sausage.h"
 
 
+/** seconds since an arbitrary point, to time the sausage builders */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
 int main(int argc, char** argv)
 {
     int i;
@@ -48,27 +58,54 @@ int main(int argc, char** argv)
 	    return 1;
 	}
 
-	sausage_t* s = convert_lattice_to_sausage(dag);
+    dualclue_index_t* index = dualclue_index_init("./syllable.lst");
+    sim_table_t* sim = sim_table_init(dualclue_index_get_vocab(index));
+    /** both builders on the same lattice, the index takes the improved one */
+    double t = now();
+	sausage_t* s = convert_lattice_to_sausage(dag, sim);
+    double t_improved = now() - t;
 	sausage_write(s, dag, "sausage.txt");
 	
-    lite_sausage_t* lite_s = sausage_simplify(s,dag);
+    lite_sausage_t* lite_s = sausage_simplify(s, dag, dualclue_index_get_vocab(index));
     lite_sausage_write(lite_s, "simplified_sausage.txt");
+    
+    t = now();
+    sausage_t* s_pivot = convert_lattice_to_sausage_pivot(dag);
+    double t_pivot = now() - t;
+    sausage_write(s_pivot, dag, "sausage_pivot.txt");
+    lite_sausage_t* lite_pivot = sausage_simplify(s_pivot, dag, dualclue_index_get_vocab(index));
+    lite_sausage_write(lite_pivot, "simplified_sausage_pivot.txt");
+    printf("Improved: %d slots in %.3f ms, pivot: %d slots in %.3f ms\n",
+            lite_sausage_n_slot(lite_s), t_improved * 1000, lite_sausage_n_slot(lite_pivot), t_pivot * 1000);
+    lite_sausage_free(lite_pivot);
+    sausage_free(s_pivot);
 	
-    dualclue_index_t* index = dualclue_index_init("./syllable.lst");
     dualclue_index_addhit(index, argv[1], lite_s);
 	
 	dualclue_index_write(index, "dualclue_index.txt");
+	dualclue_index_write_bin(index, "dualclue_index.bin");
     dualclue_index_free(index);
 	
-	index = dualclue_index_read("dualclue_index.txt");
+	index = dualclue_index_read_bin("dualclue_index.bin");
+	if (index == NULL)
+		return 1;
 	dualclue_index_write(index, "dualclue_index2.txt");
 	
 	
 	char* query[] = {"jie"};
-	dualclue_index_search(index, query, 1);
+	result_list_t* rl;
+	const result_t* r;
+	if (dualclue_index_search(index, query, 1, 10, &rl) >= 0) {
+		printf("#PATH:%d\n", result_list_size(rl));
+		for (r = result_list_first(rl); r; r = r->next) {
+			printf("%s [%d-%d] %d\n", r->uttid, r->start, r->end, r->score);
+		}
+		result_list_free(rl);
+	}
 	
 	
 	dualclue_index_free(index);
+    sim_table_free(sim);
     lite_sausage_free(lite_s);
     sausage_free(s);
 	return 0;
@@ -0,0 +1,218 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "uttdict.h"
+
+#define UTTDICT_INIT_SIZE 64
+
+struct uttdict_s {
+    int refcount;
+    int32 n_utt;
+    uint32* offsets;    /** offset of each utterance id in **pool** */
+    int32 n_alloc;
+    char* pool;         /** NUL-terminated utterance ids, back to back */
+    uint32 pool_size;
+    uint32 pool_alloc;
+    int32* table;       /** open addressing hash of ordinals, -1 is empty; NULL while there are none */
+    uint32 table_size;  /** power of two, at least twice **n_utt** */
+    pthread_mutex_t lock;   /** taken by interning, indexes sharing the dictionary may intern at once */
+};
+
+/** FNV-1a */
+static uint32 uttdict_hash(const char* s)
+{
+    uint32 h = 2166136261u;
+    while (*s) {
+        h ^= (unsigned char) *s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/** Slot of **uttid** in the hash table, either holding its ordinal or empty */
+static uint32 uttdict_slot(uttdict_t* d, const char* uttid)
+{
+    uint32 mask = d->table_size - 1;
+    uint32 i = uttdict_hash(uttid) & mask;
+    while (d->table[i] != -1 && strcmp(d->pool + d->offsets[d->table[i]], uttid) != 0) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static void uttdict_rehash(uttdict_t* d, uint32 table_size)
+{
+    int32 utt;
+    free(d->table);
+    d->table_size = table_size;
+    d->table = (int32*) malloc(table_size * sizeof(int32));
+    memset(d->table, 0xff, table_size * sizeof(int32));
+    for (utt = 0; utt < d->n_utt; utt++) {
+        d->table[uttdict_slot(d, d->pool + d->offsets[utt])] = utt;
+    }
+}
+
+uttdict_t* uttdict_init(void)
+{
+    uttdict_t* d = (uttdict_t*) calloc(1, sizeof(uttdict_t));
+    d->refcount = 1;
+    pthread_mutex_init(&(d->lock), NULL);
+    return d;
+}
+
+uttdict_t* uttdict_retain(uttdict_t* d)
+{
+    if (d) {
+        __sync_fetch_and_add(&(d->refcount), 1);
+    }
+    return d;
+}
+
+int uttdict_free(uttdict_t* d)
+{
+    int refcount;
+    if (!d)
+        return 0;
+    if ( (refcount = __sync_sub_and_fetch(&(d->refcount), 1)) > 0)
+        return refcount;
+    free(d->offsets);
+    free(d->pool);
+    free(d->table);
+    pthread_mutex_destroy(&(d->lock));
+    free(d);
+    return 0;
+}
+
+int32 uttdict_lookup(uttdict_t* d, const char* uttid)
+{
+    /** only reads, the table exists as soon as there is an id */
+    if (d->n_utt == 0)
+        return -1;
+    return d->table[uttdict_slot(d, uttid)];
+}
+
+/** uttdict_intern() with **lock** held */
+static int32 uttdict_intern_locked(uttdict_t* d, const char* uttid)
+{
+    int32 utt;
+    uint32 len, i;
+
+    if ( (utt = uttdict_lookup(d, uttid)) != -1)
+        return utt;
+
+    if (d->n_utt == d->n_alloc) {
+        d->n_alloc = d->n_alloc ? d->n_alloc * 2 : UTTDICT_INIT_SIZE;
+        d->offsets = (uint32*) realloc(d->offsets, d->n_alloc * sizeof(uint32));
+    }
+    len = strlen(uttid) + 1;
+    if (d->pool_size + len > d->pool_alloc) {
+        d->pool_alloc = (d->pool_size + len) * 2;
+        d->pool = (char*) realloc(d->pool, d->pool_alloc);
+    }
+    memcpy(d->pool + d->pool_size, uttid, len);
+    d->offsets[d->n_utt] = d->pool_size;
+    d->pool_size += len;
+    utt = d->n_utt++;
+
+    /** keep the load factor at or below one half */
+    if (!d->table || 2 * (uint32) d->n_utt > d->table_size) {
+        uttdict_rehash(d, d->table_size ? d->table_size * 2 : UTTDICT_INIT_SIZE);
+    } else {
+        i = uttdict_slot(d, uttid);
+        d->table[i] = utt;
+    }
+    return utt;
+}
+
+int32 uttdict_intern(uttdict_t* d, const char* uttid)
+{
+    int32 utt;
+    pthread_mutex_lock(&(d->lock));
+    utt = uttdict_intern_locked(d, uttid);
+    pthread_mutex_unlock(&(d->lock));
+    return utt;
+}
+
+const char* uttdict_str(uttdict_t* d, int32 utt)
+{
+    if (utt < 0 || utt >= d->n_utt)
+        return NULL;
+    return d->pool + d->offsets[utt];
+}
+
+int32 uttdict_size(uttdict_t* d)
+{
+    return d->n_utt;
+}
+
+size_t uttdict_write(uttdict_t* d, FILE* fp)
+{
+    uint32 n = d->n_utt;
+    uint32 pad = (4 - d->pool_size % 4) % 4;
+    static const char zero[4] = {0,};
+
+    if (fwrite(&n, sizeof(uint32), 1, fp) != 1
+        || fwrite(&(d->pool_size), sizeof(uint32), 1, fp) != 1
+        || fwrite(d->offsets, sizeof(uint32), n, fp) != n
+        || fwrite(d->pool, 1, d->pool_size, fp) != d->pool_size
+        || fwrite(zero, 1, pad, fp) != pad) {
+        return 0;
+    }
+    return 2 * sizeof(uint32) + n * sizeof(uint32) + d->pool_size + pad;
+}
+
+uttdict_t* uttdict_read_mem(const void* buf, size_t size)
+{
+    const uint32* head = (const uint32*) buf;
+    uint32 n, pool_size, i;
+    uttdict_t* d;
+
+    if (size < 2 * sizeof(uint32))
+        return NULL;
+    n = head[0];
+    pool_size = head[1];
+    if ( (2 + (size_t) n) * sizeof(uint32) + pool_size > size)
+        return NULL;
+    for (i = 0; i < n; i++) {
+        if (head[2 + i] >= pool_size)
+            return NULL;
+    }
+    if (pool_size > 0 && ((const char*) (head + 2 + n))[pool_size - 1] != '\0')
+        return NULL;
+
+    /** copy the two arrays as they are, and hash them now so that lookups never write */
+    d = uttdict_init();
+    d->n_utt = d->n_alloc = n;
+    d->offsets = (uint32*) malloc((n ? n : 1) * sizeof(uint32));
+    memcpy(d->offsets, head + 2, n * sizeof(uint32));
+    d->pool_size = d->pool_alloc = pool_size;
+    d->pool = (char*) malloc(pool_size ? pool_size : 1);
+    memcpy(d->pool, head + 2 + n, pool_size);
+    for (d->table_size = UTTDICT_INIT_SIZE; d->table_size < 2 * n; d->table_size *= 2)
+        ;
+    if (n > 0)
+        uttdict_rehash(d, d->table_size);
+    return d;
+}
+
+uttdict_t* uttdict_read_fp(FILE* fp, size_t size)
+{
+    void* buf = malloc(size ? size : 1);
+    uttdict_t* d = NULL;
+    if (fread(buf, 1, size, fp) == size)
+        d = uttdict_read_mem(buf, size);
+    free(buf);
+    return d;
+}
+
+int32* uttdict_map(uttdict_t* dst, uttdict_t* src)
+{
+    int32 utt;
+    int32* map = (int32*) malloc((src->n_utt + 1) * sizeof(int32));
+    pthread_mutex_lock(&(dst->lock));
+    for (utt = 0; utt < src->n_utt; utt++) {
+        map[utt] = uttdict_intern_locked(dst, src->pool + src->offsets[utt]);
+    }
+    pthread_mutex_unlock(&(dst->lock));
+    return map;
+}
@@ -0,0 +1,92 @@
+/*************************************************************************************************
+ * uttdict.h
+ * Interned utterance ids. Every utterance id is stored once in a string pool and hits refer to
+ * it by a 32-bit ordinal, so comparing utterances is an integer compare. One dictionary can be
+ * shared by the lattice index and the dual-clue index.
+ *
+ *************************************************************************************************/
+#ifndef __UTTDICT_H__
+#define __UTTDICT_H__
+
+#include <stdio.h>
+#include "pocketsphinx.h"
+
+/**
+ * uttdict_t
+ */
+typedef struct uttdict_s uttdict_t;
+
+/**
+ * function: uttdict_init()
+ * Create an empty dictionary with a reference count of 1
+ */
+uttdict_t* uttdict_init(void);
+
+/**
+ * function: uttdict_retain()
+ * Take another reference to the dictionary
+ */
+uttdict_t* uttdict_retain(uttdict_t* d);
+
+/**
+ * function: uttdict_free()
+ * Drop a reference, the dictionary is freed with the last one. Returns the references left.
+ */
+int uttdict_free(uttdict_t* d);
+
+/**
+ * function: uttdict_intern()
+ * Return the ordinal of **uttid**, adding it to the dictionary if it is new. Threads may intern
+ * at once, but not while others look ids up.
+ */
+int32 uttdict_intern(uttdict_t* d, const char* uttid);
+
+/**
+ * function: uttdict_lookup()
+ * Return the ordinal of **uttid**, -1 if it is not in the dictionary. Lookups only read, any
+ * number of threads may look ids up at once.
+ */
+int32 uttdict_lookup(uttdict_t* d, const char* uttid);
+
+/**
+ * function: uttdict_str()
+ * Return the utterance id of ordinal **utt**, NULL if out of range
+ */
+const char* uttdict_str(uttdict_t* d, int32 utt);
+
+/**
+ * function: uttdict_size()
+ * Return the number of utterances in the dictionary
+ */
+int32 uttdict_size(uttdict_t* d);
+
+/**
+ * function: uttdict_write()
+ * Append the dictionary to a binary file as
+ *   uint32 n_utt, uint32 pool_size, uint32 offsets[n_utt], char pool[pool_size] (padded to 4 bytes)
+ * Returns the number of bytes written, 0 on error
+ */
+size_t uttdict_write(uttdict_t* d, FILE* fp);
+
+/**
+ * function: uttdict_read_mem()
+ * Load a dictionary written by uttdict_write() from memory, e.g. a mapped index.
+ * Returns NULL if the section does not fit in **size** bytes or is corrupted.
+ */
+uttdict_t* uttdict_read_mem(const void* buf, size_t size);
+
+/**
+ * function: uttdict_read_fp()
+ * Load a dictionary of **size** bytes written by uttdict_write() from the current position of
+ * **fp**. Returns NULL on a short read or a corrupted section.
+ */
+uttdict_t* uttdict_read_fp(FILE* fp, size_t size);
+
+/**
+ * function: uttdict_map()
+ * Intern every utterance id of **src** in **dst** and return the array mapping the ordinals of
+ * **src** to those of **dst**, to be freed by the caller. Interns as uttdict_intern() does.
+ */
+int32* uttdict_map(uttdict_t* dst, uttdict_t* src);
+
+#endif
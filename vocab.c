@@ -0,0 +1,253 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vocab.h"
+
+#define WORD_MAX_LENGTH 15
+#define MAX_DISPLACEMENT (1 << 16)
+
+/**
+ * The perfect hash is a hash-and-displace scheme: a word first falls into a
+ * bucket through hash(word, 0), and the bucket stores the seed **d** for which
+ * hash(word, d) sends every word of the bucket to its own slot of the table.
+ */
+struct vocab_s {
+    int refcount;
+    int n_word;
+    uint32* offsets;    /** offset of each word in **pool** */
+    char* pool;         /** NUL-terminated words, back to back */
+    uint32 pool_size;
+
+    uint32 n_bucket;
+    uint32* disp;       /** displacement seed of each bucket, 0 for an empty bucket */
+    uint32 table_size;  /** power of two */
+    int32* table;       /** wid stored in each slot, -1 is empty */
+};
+
+static uint32 vocab_hash(const char* s, uint32 seed)
+{
+    uint32 h = 2166136261u ^ (seed * 0x9e3779b9u);
+    while (*s) {
+        h ^= (unsigned char) *s++;
+        h *= 16777619u;
+    }
+    /** finalizer of murmur3, so that different seeds give unrelated slots */
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+/** Place every bucket, largest first. Returns 0 on success, -1 if some bucket found no seed */
+static int vocab_build_hash(vocab_t* v)
+{
+    uint32 mask = v->table_size - 1;
+    uint32 b, d, i, j, k, slot;
+    uint32 *bucket_of, *count, *first, *members, *order, *slots;
+    int w, ok;
+
+    bucket_of = (uint32*) malloc((v->n_word + 1) * sizeof(uint32));
+    count = (uint32*) calloc(v->n_bucket + 1, sizeof(uint32));
+    first = (uint32*) calloc(v->n_bucket + 1, sizeof(uint32));
+    members = (uint32*) malloc((v->n_word + 1) * sizeof(uint32));
+    order = (uint32*) malloc(v->n_bucket * sizeof(uint32));
+    slots = (uint32*) malloc((v->n_word + 1) * sizeof(uint32));
+
+    for (w = 0; w < v->n_word; w++) {
+        bucket_of[w] = vocab_hash(v->pool + v->offsets[w], 0) % v->n_bucket;
+        count[bucket_of[w]]++;
+    }
+    for (b = 1; b <= v->n_bucket; b++) {
+        first[b] = first[b-1] + count[b-1];
+    }
+    memset(count, 0, (v->n_bucket + 1) * sizeof(uint32));
+    for (w = 0; w < v->n_word; w++) {
+        b = bucket_of[w];
+        members[first[b] + count[b]++] = w;
+    }
+    /** bucket order by decreasing size (insertion sort is fine, sizes are tiny) */
+    for (b = 0; b < v->n_bucket; b++) {
+        for (i = b; i > 0 && count[order[i-1]] < count[b]; i--) {
+            order[i] = order[i-1];
+        }
+        order[i] = b;
+    }
+
+    memset(v->table, 0xff, v->table_size * sizeof(int32));
+    memset(v->disp, 0, v->n_bucket * sizeof(uint32));
+    ok = 0;
+    for (i = 0; i < v->n_bucket; i++) {
+        b = order[i];
+        if (count[b] == 0)
+            break;
+        for (d = 1; d < MAX_DISPLACEMENT; d++) {
+            for (j = 0; j < count[b]; j++) {
+                w = members[first[b] + j];
+                slot = vocab_hash(v->pool + v->offsets[w], d) & mask;
+                if (v->table[slot] != -1)
+                    break;
+                for (k = 0; k < j; k++) {
+                    if (slots[k] == slot)
+                        break;
+                }
+                if (k < j) {
+                    /** a repeated word collides with itself, keep the first wid only */
+                    if (strcmp(v->pool + v->offsets[members[first[b] + k]], v->pool + v->offsets[w]) != 0)
+                        break;
+                    slots[j] = (uint32) -1;
+                    continue;
+                }
+                slots[j] = slot;
+            }
+            if (j == count[b])
+                break;
+        }
+        if (d == MAX_DISPLACEMENT) {
+            ok = -1;
+            break;
+        }
+        v->disp[b] = d;
+        for (j = 0; j < count[b]; j++) {
+            if (slots[j] != (uint32) -1)
+                v->table[slots[j]] = members[first[b] + j];
+        }
+    }
+
+    free(bucket_of);
+    free(count);
+    free(first);
+    free(members);
+    free(order);
+    free(slots);
+    return ok;
+}
+
+vocab_t* vocab_init(const char* const* words, int n_word)
+{
+    int i;
+    size_t len;
+    vocab_t* v = (vocab_t*) calloc(1, sizeof(vocab_t));
+    v->refcount = 1;
+    v->n_word = n_word;
+    v->offsets = (uint32*) malloc((n_word + 1) * sizeof(uint32));
+    for (i = 0; i < n_word; i++) {
+        len = strlen(words[i]);
+        v->pool_size += ((len < WORD_MAX_LENGTH) ? len : WORD_MAX_LENGTH) + 1;
+    }
+    v->pool = (char*) calloc(v->pool_size + 1, sizeof(char));
+    v->pool_size = 0;
+    for (i = 0; i < n_word; i++) {
+        v->offsets[i] = v->pool_size;
+        strncpy(v->pool + v->pool_size, words[i], WORD_MAX_LENGTH);
+        v->pool_size += strlen(v->pool + v->pool_size) + 1;
+    }
+
+    v->n_bucket = n_word / 2 + 1;
+    v->disp = (uint32*) malloc(v->n_bucket * sizeof(uint32));
+    for (v->table_size = 8; v->table_size < 2 * (uint32) n_word; v->table_size *= 2)
+        ;
+    v->table = (int32*) malloc(v->table_size * sizeof(int32));
+    /** more room makes placement easier, this practically never loops */
+    while (vocab_build_hash(v) != 0) {
+        v->table_size *= 2;
+        v->table = (int32*) realloc(v->table, v->table_size * sizeof(int32));
+    }
+    return v;
+}
+
+vocab_t* vocab_read(const char* filename)
+{
+    FILE* fh;
+    char s[WORD_MAX_LENGTH + 2] = {'\0',};
+    char** words = NULL;
+    int n_word = 0, n_alloc = 0, i;
+    char* w;
+    vocab_t* v;
+
+    if ( (fh = fopen(filename, "r")) == NULL) {
+        perror("Failed to open Word List file.");
+        return NULL;
+    }
+    while (fgets(s, WORD_MAX_LENGTH + 2, fh) != NULL) {
+        if ( (w = strtok(s, "\r\n")) == NULL)
+            continue;
+        if (n_word == n_alloc) {
+            n_alloc = n_alloc ? n_alloc * 2 : 512;
+            words = (char**) realloc(words, n_alloc * sizeof(char*));
+        }
+        words[n_word] = (char*) calloc(WORD_MAX_LENGTH + 1, sizeof(char));
+        strncpy(words[n_word], w, WORD_MAX_LENGTH);
+        n_word++;
+    }
+    fclose(fh);
+
+    v = vocab_init((const char* const*) words, n_word);
+    for (i = 0; i < n_word; i++) {
+        free(words[i]);
+    }
+    free(words);
+    return v;
+}
+
+vocab_t* vocab_retain(vocab_t* v)
+{
+    if (v) {
+        __sync_fetch_and_add(&(v->refcount), 1);
+    }
+    return v;
+}
+
+int vocab_free(vocab_t* v)
+{
+    int refcount;
+    if (!v)
+        return 0;
+    if ( (refcount = __sync_sub_and_fetch(&(v->refcount), 1)) > 0)
+        return refcount;
+    free(v->offsets);
+    free(v->pool);
+    free(v->disp);
+    free(v->table);
+    free(v);
+    return 0;
+}
+
+int vocab_wid(vocab_t* v, const char* word)
+{
+    uint32 d = v->disp[vocab_hash(word, 0) % v->n_bucket];
+    int32 wid;
+    if (d == 0)
+        return -1;
+    wid = v->table[vocab_hash(word, d) & (v->table_size - 1)];
+    if (wid < 0 || strcmp(v->pool + v->offsets[wid], word) != 0)
+        return -1;
+    return wid;
+}
+
+const char* vocab_word(vocab_t* v, int wid)
+{
+    if (wid < 0 || wid >= v->n_word)
+        return NULL;
+    return v->pool + v->offsets[wid];
+}
+
+int vocab_size(vocab_t* v)
+{
+    return v->n_word;
+}
+
+int vocab_equal(vocab_t* a, vocab_t* b)
+{
+    int i;
+    if (a == b)
+        return 1;
+    if (!a || !b || a->n_word != b->n_word)
+        return 0;
+    for (i = 0; i < a->n_word; i++) {
+        if (strcmp(vocab_word(a, i), vocab_word(b, i)) != 0)
+            return 0;
+    }
+    return 1;
+}
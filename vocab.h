@@ -0,0 +1,66 @@
+/*************************************************************************************************
+ * vocab.h
+ * Closed word (syllable) list shared by the lattice index and the dual-clue index. Words live in
+ * one contiguous string pool and are looked up through a perfect hash built when the list is
+ * loaded, so word -> wid costs one hash evaluation and one string compare.
+ *
+ *************************************************************************************************/
+#ifndef __VOCAB_H__
+#define __VOCAB_H__
+
+#include "pocketsphinx.h"
+
+/**
+ * vocab_t
+ */
+typedef struct vocab_s vocab_t;
+
+/**
+ * function: vocab_read()
+ * Load a word list with one word per line, e.g. syllable.lst; wids follow the line order
+ */
+vocab_t* vocab_read(const char* filename);
+
+/**
+ * function: vocab_init()
+ * Build a vocabulary from **n_word** words; the strings are copied into the pool
+ */
+vocab_t* vocab_init(const char* const* words, int n_word);
+
+/**
+ * function: vocab_retain()
+ * Take another reference to the vocabulary
+ */
+vocab_t* vocab_retain(vocab_t* v);
+
+/**
+ * function: vocab_free()
+ * Drop a reference, the vocabulary is freed with the last one. Returns the references left.
+ */
+int vocab_free(vocab_t* v);
+
+/**
+ * function: vocab_wid()
+ * Return the wid of **word**, -1 if it is not in the vocabulary
+ */
+int vocab_wid(vocab_t* v, const char* word);
+
+/**
+ * function: vocab_word()
+ * Return the word of **wid**, NULL if out of range
+ */
+const char* vocab_word(vocab_t* v, int wid);
+
+/**
+ * function: vocab_size()
+ * Return the number of words
+ */
+int vocab_size(vocab_t* v);
+
+/**
+ * function: vocab_equal()
+ * Return 1 if **a** and **b** hold the same words with the same wids, 0 otherwise
+ */
+int vocab_equal(vocab_t* a, vocab_t* b);
+
+#endif